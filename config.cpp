@@ -127,6 +127,25 @@ bool CfgParseJSONBit(const char *bit) {
   return false;
 }
 
+bool CfgParseOutput(const char *format) {
+  if (!strcmp(format, "text"))
+    opt_output = OutputFormat::Text;
+  else if (!strcmp(format, "ndjson"))
+    opt_output = OutputFormat::NDJSON;
+  else if (!strcmp(format, "binary"))
+    opt_output = OutputFormat::Binary;
+  else {
+    log(Error, "unknown output format: %s\n", format);
+    return false;
+  }
+  return true;
+}
+
+static bool cfg_output(std::string &line) {
+  (void)CfgParseOutput(line.c_str());
+  return true;
+}
+
 static bool cfg_json(std::string &line) {
   (void)CfgParseJSONBit(line.c_str());
   return true;
@@ -158,8 +177,12 @@ static bool ReadConfig(std::istream &in, const char *path) {
       std::make_tuple("package_depends",  cfg_bool(opt_package_depends)),
       std::make_tuple("josn",             cfg_json),
       std::make_tuple("json",             cfg_json),
+      std::make_tuple("output",           cfg_output),
       std::make_tuple("jobs",             cfg_numeric(opt_max_jobs)),
       std::make_tuple("file_lists",       cfg_bool(opt_package_filelist)),
+      std::make_tuple("symbols",          cfg_bool(opt_package_symbols)),
+      std::make_tuple("fast_archives",    cfg_bool(opt_archive_fast)),
+      std::make_tuple("mmap",             cfg_bool(opt_archive_mmap)),
     };
 
     for (auto &r : rules) {
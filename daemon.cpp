@@ -0,0 +1,784 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#ifdef ENABLE_THREADS
+#  include <pthread.h>
+#  include <thread>
+#  include <mutex>
+#endif
+
+#include <algorithm>
+#include <deque>
+
+#include "main.h"
+
+// The daemon keeps a database in memory and answers queries on a UNIX
+// socket. Each query runs in a forked child, which sees the database as
+// it was at the time of the fork and parses the query's arguments like a
+// regular invocation would.
+//
+// Queries which modify the database run one at a time, each on the
+// version the previous one produced. The writing child stores the file,
+// which the daemon then reads into a new version in the background while
+// other queries keep being answered from the old one. The writer's client
+// gets its reply once the new version is in place.
+//
+// A client sends one message carrying its stdout and stderr descriptors
+// and a Header, followed by its working directory and its arguments, each
+// terminated by a nul byte. The child writes to the client's descriptors
+// directly. Once it is done the daemon replies with its 32 bit exit status.
+
+struct Header {
+  uint32_t length; // of the working directory and arguments
+  uint32_t flags;
+};
+
+enum : uint32_t {
+  QueryWrites = 1 // the query modifies the database
+};
+
+static const uint32_t max_request = 1024*1024;
+
+static int  signal_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t stopping = 0;
+
+// wakes up the main loop
+static void wake() {
+  char c = 0;
+  if (::write(signal_pipe[1], &c, 1) < 0) {
+    // the pipe is full, which wakes the loop up as well
+  }
+}
+
+static void on_signal(int sig) {
+  int saved = errno;
+  if (sig != SIGCHLD)
+    stopping = 1;
+  wake();
+  errno = saved;
+}
+
+static bool write_all(int fd, const void *data_, size_t length) {
+  const char *data = reinterpret_cast<const char*>(data_);
+  while (length) {
+    ssize_t put = ::write(fd, data, length);
+    if (put < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data   += put;
+    length -= size_t(put);
+  }
+  return true;
+}
+
+static bool read_all(int fd, void *data_, size_t length) {
+  char *data = reinterpret_cast<char*>(data_);
+  while (length) {
+    ssize_t got = ::read(fd, data, length);
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (!got)
+      return false;
+    data   += got;
+    length -= size_t(got);
+  }
+  return true;
+}
+
+static bool make_address(const std::string &path, struct sockaddr_un &addr) {
+  if (path.length() >= sizeof(addr.sun_path)) {
+    log(Error, "socket path too long: %s\n", path.c_str());
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.length());
+  return true;
+}
+
+static int connect_to(const struct sockaddr_un &addr) {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (::connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    int saved = errno;
+    ::close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+static int exit_code(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return 1;
+}
+
+static void reply(int fd, int code) {
+  uint32_t status = uint32_t(code);
+  write_all(fd, &status, sizeof(status));
+  ::close(fd);
+}
+
+int daemon_query(const std::string &path, int argc, char **argv,
+                 bool writes)
+{
+  struct sockaddr_un addr;
+  if (!make_address(path, addr))
+    return 1;
+
+  char cwd[PATH_MAX];
+  if (!::getcwd(cwd, sizeof(cwd))) {
+    log(Error, "getcwd: %s\n", ::strerror(errno));
+    return 1;
+  }
+  std::string request(cwd, strlen(cwd)+1);
+  for (int i = 0; i != argc; ++i)
+    request.append(argv[i], strlen(argv[i])+1);
+  if (request.length() > max_request) {
+    log(Error, "query too long\n");
+    return 1;
+  }
+
+  int fd = connect_to(addr);
+  if (fd < 0) {
+    log(Error, "failed to connect to %s: %s\n",
+        path.c_str(), ::strerror(errno));
+    return 1;
+  }
+
+  Header hdr = { uint32_t(request.length()),
+                 writes ? uint32_t(QueryWrites) : 0u };
+  struct iovec iov = { &hdr, sizeof(hdr) };
+  int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+  union {
+    char           buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  // the daemon may turn a query down without reading all of it, its
+  // reply is still there to be read
+  ::signal(SIGPIPE, SIG_IGN);
+
+  uint32_t status;
+  if ((::sendmsg(fd, &msg, 0) != ssize_t(sizeof(hdr)) ||
+       !write_all(fd, request.data(), request.length())) &&
+      errno != EPIPE)
+  {
+    log(Error, "failed to send the query: %s\n", ::strerror(errno));
+    ::close(fd);
+    return 1;
+  }
+  if (!read_all(fd, &status, sizeof(status))) {
+    log(Error, "lost the connection to the daemon\n");
+    ::close(fd);
+    return 1;
+  }
+  ::close(fd);
+  return int(status);
+}
+
+// A connection whose header has arrived.
+struct Query {
+  int    fd;
+  int    out, err;
+  Header hdr;
+};
+
+// Receives the header and the client's descriptors without blocking.
+// Returns 1 when done, 0 when the header is yet to arrive, -1 when the
+// connection is to be dropped.
+static int receive_header(int fd, Query &q) {
+  int fds[2];
+  union {
+    char           buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { &q.hdr, sizeof(q.hdr) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t got = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+  if (got < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+           ? 0 : -1;
+  if (got == 0) // closed without a query, see listen_on()
+    return -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS)
+  {
+    log(Error, "malformed query\n");
+    return -1;
+  }
+  if (cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    // close whatever we were sent
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i != count; ++i) {
+      int extra;
+      memcpy(&extra, CMSG_DATA(cmsg) + i*sizeof(int), sizeof(int));
+      ::close(extra);
+    }
+    log(Error, "malformed query\n");
+    return -1;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  if (got != ssize_t(sizeof(q.hdr)) ||
+      !q.hdr.length || q.hdr.length > max_request)
+  {
+    ::close(fds[0]);
+    ::close(fds[1]);
+    log(Error, "malformed query\n");
+    return -1;
+  }
+  q.fd  = fd;
+  q.out = fds[0];
+  q.err = fds[1];
+  return 1;
+}
+
+// Runs in the forked child: takes over the client's output descriptors
+// and runs the query.
+static int serve_query(const Query &q, const DaemonDB *daemon,
+                       DaemonQuery query)
+{
+  if (::dup2(q.out, STDOUT_FILENO) < 0 || ::dup2(q.err, STDERR_FILENO) < 0)
+    return 1;
+  ::close(q.out);
+  ::close(q.err);
+
+  uint32_t length = q.hdr.length;
+  std::string request(length, '\0');
+  if (!read_all(q.fd, &request[0], length) || request[length-1] != 0) {
+    log(Error, "malformed query\n");
+    return 1;
+  }
+
+  std::vector<char*> argv;
+  for (size_t at = 0; at != length; at += strlen(&request[at]) + 1)
+    argv.push_back(&request[at]);
+  if (argv.size() < 2) {
+    log(Error, "malformed query\n");
+    return 1;
+  }
+  if (::chdir(argv[0]) != 0)
+    log(Warn, "cannot enter %s: %s\n", argv[0], ::strerror(errno));
+  argv.erase(argv.begin());
+  int argc = int(argv.size());
+  argv.push_back(nullptr);
+
+#ifdef __GLIBC__
+  optind = 0;
+#else
+  optind = 1;
+  optreset = 1;
+#endif
+  return query(argc, argv.data(), daemon);
+}
+
+// Identifies the version of the database file which was loaded.
+struct FileStamp {
+  dev_t           dev;
+  ino_t           ino;
+  off_t           size;
+  struct timespec mtime;
+
+  bool operator==(const FileStamp &o) const {
+    return dev == o.dev && ino == o.ino && size == o.size &&
+           mtime.tv_sec  == o.mtime.tv_sec &&
+           mtime.tv_nsec == o.mtime.tv_nsec;
+  }
+  bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+
+static bool stamp_file(const std::string &path, FileStamp &stamp) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return false;
+  stamp.dev   = st.st_dev;
+  stamp.ino   = st.st_ino;
+  stamp.size  = st.st_size;
+  stamp.mtime = st.st_mtim;
+  return true;
+}
+
+// The version of the database queries are forked from. A new version is
+// read on a thread while queries keep being forked from the current one,
+// and is published by swapping the pointer. Forks happen with the lock
+// held, so a version which was swapped out is not in use and gets freed
+// right away: each child has its own copy.
+class Versions {
+ public:
+  Versions(const std::string &dbfile);
+  ~Versions();
+
+  bool  Load();          // reads the first version
+  bool  Refresh();       // starts reading the file if it changed
+  bool  Loading();       // whether a new version is still being read
+  bool  Stale();         // whether the file is a version we failed to read
+  void  Wait();          // for a reload in progress
+  pid_t Fork(DB **db);   // fork() giving the child the current version
+
+ private:
+  void  Read(FileStamp stamp);
+
+  std::string         dbfile_;
+  std::unique_ptr<DB> db_;
+  FileStamp           loaded_;
+  FileStamp           failed_; // a version we could not read
+#ifdef ENABLE_THREADS
+  std::mutex          mutex_;
+  std::thread         loader_;
+  bool                loading_;
+  bool                done_;
+#endif
+};
+
+Versions::Versions(const std::string &dbfile)
+  : dbfile_(dbfile)
+{
+  memset(&loaded_, 0, sizeof(loaded_));
+  memset(&failed_, 0, sizeof(failed_));
+#ifdef ENABLE_THREADS
+  loading_ = false;
+  done_    = false;
+#endif
+}
+
+Versions::~Versions() {
+  Wait();
+}
+
+void Versions::Wait() {
+#ifdef ENABLE_THREADS
+  if (loading_) {
+    loader_.join();
+    loading_ = false;
+  }
+#endif
+}
+
+bool Versions::Load() {
+  if (!stamp_file(dbfile_, loaded_)) {
+    log(Error, "cannot access %s: %s\n", dbfile_.c_str(), ::strerror(errno));
+    return false;
+  }
+  db_.reset(new DB);
+  if (!db_->Read(dbfile_)) {
+    log(Error, "failed to read database\n");
+    return false;
+  }
+  // once here rather than in every forked query
+  db_->BuildQueryIndex();
+  return true;
+}
+
+bool Versions::Refresh() {
+  FileStamp now;
+  if (Loading() || !stamp_file(dbfile_, now) ||
+      now == loaded_ || now == failed_)
+  {
+    return false;
+  }
+#ifdef ENABLE_THREADS
+  loading_ = true;
+  done_    = false;
+  loader_  = std::thread(&Versions::Read, this, now);
+#else
+  Read(now);
+#endif
+  return true;
+}
+
+void Versions::Read(FileStamp stamp) {
+  log(Message, "reloading %s\n", dbfile_.c_str());
+  std::unique_ptr<DB> fresh(new DB);
+  bool ok = fresh->Read(dbfile_);
+  if (ok)
+    fresh->BuildQueryIndex();
+  else
+    log(Error, "failed to reload the database, keeping the old one\n");
+  {
+#ifdef ENABLE_THREADS
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    if (ok) {
+      db_.swap(fresh);
+      loaded_ = stamp;
+    } else
+      failed_ = stamp;
+#ifdef ENABLE_THREADS
+    done_ = true;
+#endif
+  }
+  // the old version
+  fresh.reset();
+  wake();
+}
+
+bool Versions::Loading() {
+#ifdef ENABLE_THREADS
+  if (!loading_)
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!done_)
+      return true;
+  }
+  loader_.join();
+  loading_ = false;
+#endif
+  return false;
+}
+
+bool Versions::Stale() {
+  FileStamp now;
+  return stamp_file(dbfile_, now) && now == failed_;
+}
+
+pid_t Versions::Fork(DB **db) {
+#ifdef ENABLE_THREADS
+  std::lock_guard<std::mutex> lock(mutex_);
+#endif
+  *db = db_.get();
+  fflush(nullptr);
+  return ::fork();
+}
+
+#ifdef ENABLE_THREADS
+// The loader thread may be logging or interning symbols while we fork.
+static void fork_prepare() {
+  symbols::Lock();
+  flockfile(stdout);
+  flockfile(stderr);
+}
+
+static void fork_done() {
+  funlockfile(stderr);
+  funlockfile(stdout);
+  symbols::Unlock();
+}
+#endif
+
+static int listen_on(const std::string &path) {
+  struct sockaddr_un addr;
+  if (!make_address(path, addr))
+    return -1;
+
+  struct stat st;
+  if (::lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      log(Error, "%s exists and is not a socket\n", path.c_str());
+      return -1;
+    }
+    int other = connect_to(addr);
+    if (other >= 0) {
+      ::close(other);
+      log(Error, "a daemon is already listening on %s\n", path.c_str());
+      return -1;
+    }
+    // left behind by a daemon which did not exit cleanly
+    ::unlink(path.c_str());
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    log(Error, "socket: %s\n", ::strerror(errno));
+    return -1;
+  }
+  if (::bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      ::listen(fd, SOMAXCONN) != 0)
+  {
+    log(Error, "failed to listen on %s: %s\n",
+        path.c_str(), ::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+int daemon_serve(const std::string &path, const std::string &dbfile_,
+                 DaemonQuery query)
+{
+  // writing queries run in the client's working directory
+  std::string dbfile(dbfile_);
+  if (dbfile.empty() || dbfile[0] != '/') {
+    char cwd[PATH_MAX];
+    if (!::getcwd(cwd, sizeof(cwd))) {
+      log(Error, "getcwd: %s\n", ::strerror(errno));
+      return 1;
+    }
+    dbfile = std::string(cwd) + "/" + dbfile;
+  }
+
+  int listener = listen_on(path);
+  if (listener < 0)
+    return 1;
+
+  Versions versions(dbfile);
+  if (!versions.Load() || ::pipe(signal_pipe) != 0) {
+    ::close(listener);
+    ::unlink(path.c_str());
+    return 1;
+  }
+  for (int fd : signal_pipe)
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+#ifdef ENABLE_THREADS
+  ::pthread_atfork(fork_prepare, fork_done, fork_done);
+#endif
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_NOCLDSTOP;
+  ::sigaction(SIGCHLD, &sa, nullptr);
+  ::sigaction(SIGINT,  &sa, nullptr);
+  ::sigaction(SIGTERM, &sa, nullptr);
+  ::sigaction(SIGHUP,  &sa, nullptr);
+  ::signal(SIGPIPE, SIG_IGN);
+
+  log(Message, "serving %s on %s\n", dbfile.c_str(), path.c_str());
+  fflush(nullptr);
+
+  std::vector<int>     accepted; // connections without a header yet
+  std::vector<Query>   reads;    // queries to start
+  std::deque<Query>    writes;   // writing queries waiting for their turn
+  std::map<pid_t, int> running;  // connections to reply to once done
+  pid_t                writer      = -1;
+  int                  writer_err  = -1; // kept to report a failed reload
+  int                  held        = -1; // the writer's connection...
+  int                  held_err    = -1;
+  int                  held_status = 0;  // ...waiting for its version
+
+  // writing on top of a version we could not read would drop it
+  auto refuse = [](const Query &q) {
+    ::dprintf(q.err, "the daemon could not read the current database file,"
+                     " not modifying it\n");
+    ::close(q.out);
+    ::close(q.err);
+    reply(q.fd, 1);
+  };
+
+  // runs a query in a child process
+  auto start = [&](const Query &q, bool writable) -> pid_t {
+    DB   *db;
+    pid_t pid = versions.Fork(&db);
+    if (pid < 0) {
+      log(Error, "fork: %s\n", ::strerror(errno));
+      ::close(q.out);
+      ::close(q.err);
+      reply(q.fd, 1);
+      return -1;
+    }
+    if (pid == 0) {
+      ::signal(SIGCHLD, SIG_DFL);
+      ::signal(SIGINT,  SIG_DFL);
+      ::signal(SIGTERM, SIG_DFL);
+      ::signal(SIGHUP,  SIG_DFL);
+      ::signal(SIGPIPE, SIG_DFL);
+      ::close(listener);
+      ::close(signal_pipe[0]);
+      ::close(signal_pipe[1]);
+      // other clients must not wait on us for their output to end
+      for (int fd : accepted)
+        ::close(fd);
+      for (auto &other : reads) {
+        ::close(other.fd);
+        ::close(other.out);
+        ::close(other.err);
+      }
+      for (auto &other : writes) {
+        ::close(other.fd);
+        ::close(other.out);
+        ::close(other.err);
+      }
+      for (auto &r : running)
+        ::close(r.second);
+      if (held >= 0)
+        ::close(held);
+      if (held_err >= 0)
+        ::close(held_err);
+      if (writer_err >= 0)
+        ::close(writer_err);
+
+      DaemonDB daemon = { db, &dbfile, writable };
+      int code = serve_query(q, &daemon, query);
+      fflush(nullptr);
+      ::_exit(code);
+    }
+    ::close(q.out);
+    if (writable)
+      writer_err = q.err;
+    else
+      ::close(q.err);
+    running[pid] = q.fd;
+    return pid;
+  };
+
+  while (!stopping) {
+    std::vector<struct pollfd> pfd;
+    pfd.push_back({ listener,       POLLIN, 0 });
+    pfd.push_back({ signal_pipe[0], POLLIN, 0 });
+    for (int fd : accepted)
+      pfd.push_back({ fd, POLLIN, 0 });
+    if (::poll(&pfd[0], pfd.size(), -1) < 0 && errno != EINTR) {
+      log(Error, "poll: %s\n", ::strerror(errno));
+      break;
+    }
+
+    if (pfd[1].revents) {
+      char buf[64];
+      while (::read(signal_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    }
+
+    int   status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+      auto done = running.find(pid);
+      if (done == running.end())
+        continue;
+      if (pid == writer) {
+        writer      = -1;
+        held        = done->second;
+        held_err    = writer_err;
+        writer_err  = -1;
+        held_status = exit_code(status);
+        versions.Refresh();
+      } else
+        reply(done->second, exit_code(status));
+      running.erase(done);
+    }
+
+    bool loading = versions.Loading();
+    if (held >= 0 && !loading) {
+      // the change was stored but queries would not see it
+      if (held_status == 0 && versions.Stale()) {
+        ::dprintf(held_err, "the daemon failed to read the modified"
+                            " database back\n");
+        held_status = 1;
+      }
+      ::close(held_err);
+      reply(held, held_status);
+      held     = -1;
+      held_err = -1;
+    }
+
+    if (stopping)
+      break;
+
+    // new connections, and headers of earlier ones
+    for (size_t i = 2; i != pfd.size(); ++i) {
+      if (!pfd[i].revents)
+        continue;
+      Query q;
+      int got = receive_header(pfd[i].fd, q);
+      if (got == 0)
+        continue;
+      accepted.erase(std::find(accepted.begin(), accepted.end(),
+                               pfd[i].fd));
+      if (got < 0)
+        ::close(pfd[i].fd);
+      else if (q.hdr.flags & QueryWrites)
+        writes.push_back(q);
+      else
+        reads.push_back(q);
+    }
+    if (pfd[0].revents & POLLIN) {
+      int client;
+      while ((client = ::accept(listener, nullptr, nullptr)) >= 0) {
+        ::fcntl(client, F_SETFL, ::fcntl(client, F_GETFL) & ~O_NONBLOCK);
+        accepted.push_back(client);
+      }
+    }
+
+    bool idle = writer < 0 && held < 0 && !loading;
+    // pick up changes made to the file by others; until they are read
+    // queries are answered from the current version
+    if (idle && (reads.size() || writes.size())) {
+      versions.Refresh();
+      loading = versions.Loading();
+      idle    = !loading;
+    }
+
+    while (reads.size()) {
+      Query q = reads.back();
+      reads.pop_back();
+      start(q, false);
+    }
+
+    while (idle && writes.size() && versions.Stale()) {
+      refuse(writes.front());
+      writes.pop_front();
+    }
+    if (idle && writes.size()) {
+      Query q = writes.front();
+      writes.pop_front();
+      writer = start(q, true);
+    }
+  }
+
+  log(Message, "shutting down\n");
+  versions.Wait();
+  ::close(listener);
+  ::unlink(path.c_str());
+  for (int fd : accepted)
+    ::close(fd);
+  for (auto &q : writes) {
+    ::close(q.fd);
+    ::close(q.out);
+    ::close(q.err);
+  }
+  for (auto &r : running)
+    ::close(r.second);
+  if (held >= 0)
+    ::close(held);
+  if (held_err >= 0)
+    ::close(held_err);
+  if (writer_err >= 0)
+    ::close(writer_err);
+  ::close(signal_pipe[0]);
+  ::close(signal_pipe[1]);
+  return 0;
+}
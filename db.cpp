@@ -1,6 +1,9 @@
+#include <stdarg.h>
+
 #include <memory>
 #include <algorithm>
 #include <utility>
+#include <iterator>
 
 #ifdef ENABLE_THREADS
 #  include <atomic>
@@ -13,6 +16,10 @@
 #  include <alpm.h>
 #endif
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #include "main.h"
 
 using ObjClass = uint32_t;
@@ -24,16 +31,67 @@ static inline ObjClass getObjClass(unsigned char ei_class,
   return static_cast<ObjClass>((ei_data << 16) | (ei_class << 8) | ei_osabi);
 }
 
-static inline ObjClass getObjClass(Elf *elf) {
+static inline ObjClass getObjClass(const Elf *elf) {
   return getObjClass(elf->ei_class_, elf->ei_data_, elf->ei_osabi_);
 }
 
+// Elf::CanUse on packed object classes
+static inline bool classCanUse(ObjClass obj, ObjClass lib, bool strict) {
+  if ((obj & ~0xFFu) != (lib & ~0xFFu))
+    return false;
+  const uint32_t osabi = obj & 0xFF, libosabi = lib & 0xFF;
+  return (osabi == libosabi) || (!strict && (!osabi || !libosabi));
+}
+
+// Find the next table entry at or after `from` with the wanted name and a
+// usable object class. Checks 4 entries at a time where SSE2 is available.
+static size_t nextCandidate(const uint32_t *names, const ObjClass *classes,
+                            size_t from, size_t count,
+                            uint32_t name, ObjClass objclass, bool strict)
+{
+#ifdef __SSE2__
+  const __m128i want    = _mm_set1_epi32(int(name));
+  const __m128i abimask = _mm_set1_epi32(int(~0xFFu));
+  const __m128i abi     = _mm_set1_epi32(int(objclass & ~0xFFu));
+  const __m128i osmask  = _mm_set1_epi32(0xFF);
+  const __m128i osabi   = _mm_set1_epi32(int(objclass & 0xFF));
+  const __m128i zero    = _mm_setzero_si128();
+  // a non-strict object without an osabi accepts any osabi
+  const bool anyos = !strict && !(objclass & 0xFF);
+  for (; from + 4 <= count; from += 4) {
+    __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i*>(names+from));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(classes+from));
+    __m128i hit = _mm_and_si128(_mm_cmpeq_epi32(n, want),
+                    _mm_cmpeq_epi32(_mm_and_si128(c, abimask), abi));
+    if (!anyos) {
+      __m128i os = _mm_and_si128(c, osmask);
+      __m128i osok = _mm_cmpeq_epi32(os, osabi);
+      if (!strict)
+        osok = _mm_or_si128(osok, _mm_cmpeq_epi32(os, zero));
+      hit = _mm_and_si128(hit, osok);
+    }
+    int bits = _mm_movemask_ps(_mm_castsi128_ps(hit));
+    if (bits)
+      return from + __builtin_ctz(bits);
+  }
+#endif
+  for (; from != count; ++from) {
+    if (names[from] == name && classCanUse(objclass, classes[from], strict))
+      return from;
+  }
+  return count;
+}
+
 DB::DB() {
   loaded_version_           = DB::CURRENT;
   contains_package_depends_ = false;
   contains_groups_          = false;
   contains_filelists_       = false;
+  contains_symbols_         = false;
   strict_linking_           = false;
+  ld_order_                 = false;
+  batch_.active             = false;
+  query_index_.valid        = false;
 }
 
 DB::~DB() {
@@ -56,6 +114,9 @@ DB::DB(bool wiped, const DB &copy)
 {
   loaded_version_ = copy.loaded_version_;
   strict_linking_ = copy.strict_linking_;
+  ld_order_       = copy.ld_order_;
+  batch_.active   = false;
+  query_index_.valid = false;
   if (!wiped) {
     stdreplace(packages_, copy.packages_);
     stdreplace(objects_,  copy.objects_);
@@ -75,6 +136,7 @@ Package* DB::FindPkg(const std::string& name) const {
 bool DB::WipePackages() {
   if (Empty())
     return false;
+  query_index_.valid = false;
   objects_.clear();
   packages_.clear();
   return true;
@@ -106,8 +168,39 @@ const StringList* DB::GetPackageLibPath(const Package *pkg) const {
   return nullptr;
 }
 
+void DB::BuildObjectTable() {
+  table_ = ObjectTable();
+  auto intern = [this](const std::string &name) -> uint32_t {
+    auto id = table_.ids.emplace(name, (uint32_t)table_.names.size());
+    if (id.second)
+      table_.names.push_back(name);
+    return id.first->second;
+  };
+
+  size_t count = objects_.size();
+  table_.objects.reserve(count);
+  table_.objclass.reserve(count);
+  table_.basename.reserve(count);
+  table_.dirname.reserve(count);
+  for (Elf *obj : objects_) {
+    table_.objects.push_back(obj);
+    table_.objclass.push_back(getObjClass(obj));
+    table_.basename.push_back(intern(obj->basename_));
+    table_.dirname.push_back(intern(obj->dirname_));
+  }
+
+  if (ld_order_) {
+    for (uint32_t row = 0; row != (uint32_t)count; ++row) {
+      uint64_t key = (uint64_t(table_.dirname[row]) << 32)
+                   | table_.basename[row];
+      table_.files[key].push_back(row);
+    }
+  }
+}
+
 bool DB::DeletePackage(const std::string& name)
 {
+  query_index_.valid = false;
   const Package *old; {
     auto pkgiter = FindPkg_i(name);
     if (pkgiter == packages_.end())
@@ -124,6 +217,8 @@ bool DB::DeletePackage(const std::string& name)
                    objects_.end());
   }
 
+  BuildObjectTable();
+  guard drop_table([this]() { table_ = ObjectTable(); });
   for (auto &seeker : objects_) {
     for (auto &elfsp : old->objects_) {
       Elf *elf = elfsp.get();
@@ -206,9 +301,128 @@ bool DB::ElfFinds(const Elf *elf, const std::string& path,
   return false;
 }
 
+static void pathlist_split(const std::string& list, StringList &out)
+{
+  size_t at = 0;
+  size_t to = list.find_first_of(':', 0);
+  while (to != std::string::npos) {
+    out.push_back(list.substr(at, to-at));
+    at = to+1;
+    to = list.find_first_of(':', at);
+  }
+  out.push_back(list.substr(at));
+}
+
+// The directories ElfFinds accepts for an object. With ld_order_ they're
+// in the order ld.so searches them: DT_RPATH (only without DT_RUNPATH),
+// DT_RUNPATH, the library path, the package's library path and finally
+// the trusted directories.
+void DB::SearchOrder(const Elf *elf, const StringList *extrapaths,
+                     StringList &dirs) const
+{
+  dirs.clear();
+  if (elf->rpath_set_ && (!ld_order_ || !elf->runpath_set_))
+    pathlist_split(elf->rpath_, dirs);
+  if (elf->runpath_set_)
+    pathlist_split(elf->runpath_, dirs);
+  dirs.insert(dirs.end(), library_path_.begin(), library_path_.end());
+  if (extrapaths)
+    dirs.insert(dirs.end(), extrapaths->begin(), extrapaths->end());
+  dirs.push_back("/lib");
+  dirs.push_back("/usr/lib");
+}
+
+// SearchOrder as table ids. Entries which are no object's directory cannot
+// match anything and are left out.
+void DB::SearchPath(const Elf *elf, const StringList *extrapaths,
+                    DirSet &dirs) const
+{
+  StringList paths;
+  SearchOrder(elf, extrapaths, paths);
+  dirs.clear();
+  for (auto &path : paths) {
+    auto id = table_.ids.find(path);
+    if (id != table_.ids.end())
+      dirs.push_back(id->second);
+  }
+
+  if (!ld_order_) {
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+  }
+}
+
+// Objects which are byte-identical to the ones of the installed version
+// of the package, at the same path, keep their parsed instance and link
+// results. (The package name, and thereby its library path, is the same,
+// and changes to the global paths and rules require a --relink anyway.)
+void DB::ReuseObjects(Package *old, Package *pkg,
+                      std::set<const Elf*> &reused) const
+{
+  std::map<std::string, Elf*> oldobjs;
+  for (auto &obj : old->objects_) {
+    if (obj->content_hash_)
+      oldobjs[obj->dirname_ + "/" + obj->basename_] = obj;
+  }
+  if (oldobjs.empty())
+    return;
+
+  for (auto &obj : pkg->objects_) {
+    auto iter = oldobjs.find(obj->dirname_ + "/" + obj->basename_);
+    if (iter == oldobjs.end() ||
+        iter->second->content_hash_ != obj->content_hash_)
+    {
+      continue;
+    }
+    Elf *keep = iter->second;
+    if (obj->sym_imports_.size() || obj->sym_exports_.size()) {
+      keep->sym_imports_ = std::move(obj->sym_imports_);
+      keep->sym_exports_ = std::move(obj->sym_exports_);
+    }
+    obj = keep;
+    reused.insert(keep);
+  }
+
+  // so that DeletePackage leaves them alone
+  old->objects_.erase(
+    std::remove_if(old->objects_.begin(), old->objects_.end(),
+      [&reused](rptr<Elf> &obj) { return reused.count(obj.get()) != 0; }),
+    old->objects_.end());
+}
+
+void DB::BeginBatch() {
+  batch_.active = true;
+}
+
 bool DB::InstallPackage(Package* &&pkg) {
-  if (!DeletePackage(pkg->name_))
-    return false;
+  query_index_.valid = false;
+  if (!batch_.active) {
+    BeginBatch();
+    bool ok = InstallPackage(std::move(pkg));
+    return Commit() && ok;
+  }
+
+  std::set<const Elf*> reused;
+  auto olditer = FindPkg_i(pkg->name_);
+  if (olditer != packages_.end()) {
+    Package *old = *olditer;
+    ReuseObjects(old, pkg, reused);
+    packages_.erase(packages_.begin() + (olditer - packages_.begin()));
+
+    // objects linking against the old ones get relinked in Commit
+    std::set<const Elf*> gone;
+    for (auto &obj : old->objects_) {
+      gone.insert(obj.get());
+      batch_.added.erase(obj);
+      batch_.removed.insert(obj);
+      batch_.keep.push_back(obj);
+    }
+    objects_.erase(
+      std::remove_if(objects_.begin(), objects_.end(),
+        [&gone](rptr<Elf> &obj) { return gone.count(obj.get()) != 0; }),
+      objects_.end());
+    delete old;
+  }
 
   packages_.push_back(pkg);
   if (pkg->depends_.size()    ||
@@ -223,54 +437,136 @@ bool DB::InstallPackage(Package* &&pkg) {
     contains_groups_ = true;
   if (pkg->filelist_.size())
     contains_filelists_ = true;
+  for (auto &obj : pkg->objects_) {
+    if (obj->sym_imports_.size() || obj->sym_exports_.size()) {
+      contains_symbols_ = true;
+      break;
+    }
+  }
 
-  const StringList *libpaths = GetPackageLibPath(pkg);
-
-  for (auto &obj : pkg->objects_)
+  // reused objects are still in the object list
+  for (auto &obj : pkg->objects_) {
+    obj->owner_ = pkg;
+    if (reused.count(obj))
+      continue;
     objects_.push_back(obj);
-  // loop anew since we need to also be able to found our own packages
-  for (auto &obj : pkg->objects_)
-    LinkObject_do(obj, pkg);
-
-  // check for packages which are looking for any of our packages
-  for (auto &seeker : objects_) {
-    for (auto &obj : pkg->objects_) {
-      if (!seeker->CanUse(*obj, strict_linking_) ||
-          !ElfFinds(seeker, obj->dirname_, libpaths))
-      {
-        continue;
-      }
-
-      if (0 != seeker->req_missing_.erase(obj->basename_))
-        seeker->req_found_.insert(obj);
-    }
+    batch_.added.insert(obj);
+  }
+  if (reused.size()) {
+    log(Debug, "%s: reusing %lu unchanged objects\n",
+        pkg->name_.c_str(), (unsigned long)reused.size());
   }
   return true;
 }
 
 Elf* DB::FindFor(const Elf *obj, const std::string& needed,
-                 const StringList *extrapath) const
+                 const StringList *extrapath, const ObjectIndex *index,
+                 const DirSet *searchpath) const
 {
   log(Debug, "dependency of %s/%s   :  %s\n",
       obj->dirname_.c_str(), obj->basename_.c_str(), needed.c_str());
-  for (auto &lib : objects_) {
+  auto usable = [&](const Elf *lib) -> bool {
     if (!obj->CanUse(*lib, strict_linking_)) {
       log(Debug, "  skipping %s/%s (objclass)\n",
           lib->dirname_.c_str(), lib->basename_.c_str());
-      continue;
+      return false;
     }
     if (lib->basename_    != needed) {
       log(Debug, "  skipping %s/%s (wrong name)\n",
           lib->dirname_.c_str(), lib->basename_.c_str());
-      continue;
+      return false;
     }
     if (!ElfFinds(obj, lib->dirname_, extrapath)) {
       log(Debug, "  skipping %s/%s (not visible)\n",
           lib->dirname_.c_str(), lib->basename_.c_str());
-      continue;
+      return false;
     }
     // same class, same name, and visible...
-    return lib;
+    return true;
+  };
+
+  // ld.so order: the first directory in the search path which has a
+  // usable object of that name wins
+  StringList order;
+  if (ld_order_ && !table_.objects.size())
+    SearchOrder(obj, extrapath, order);
+
+  if (index) {
+    auto libs = index->find(needed);
+    if (libs == index->end())
+      return 0;
+    for (auto &dir : order) {
+      for (Elf *lib : libs->second) {
+        if (lib->dirname_ == dir && obj->CanUse(*lib, strict_linking_))
+          return lib;
+      }
+    }
+    if (ld_order_)
+      return 0;
+    for (Elf *lib : libs->second) {
+      if (usable(lib))
+        return lib;
+    }
+    return 0;
+  }
+
+  if (table_.objects.size()) {
+    auto id = table_.ids.find(needed);
+    if (id == table_.ids.end())
+      return 0;
+    DirSet ownpath;
+    if (!searchpath) {
+      SearchPath(obj, extrapath, ownpath);
+      searchpath = &ownpath;
+    }
+    const uint32_t  want    = id->second;
+    const ObjClass  cls     = getObjClass(obj);
+    if (ld_order_) {
+      for (uint32_t dir : *searchpath) {
+        auto rows = table_.files.find((uint64_t(dir) << 32) | want);
+        if (rows == table_.files.end())
+          continue;
+        for (uint32_t row : rows->second) {
+          if (classCanUse(cls, table_.objclass[row], strict_linking_))
+            return table_.objects[row];
+        }
+      }
+      return 0;
+    }
+    const uint32_t *names   = &table_.basename[0];
+    const ObjClass *classes = &table_.objclass[0];
+    const size_t    count   = table_.objects.size();
+    for (size_t i = nextCandidate(names, classes, 0, count, want, cls,
+                                  strict_linking_);
+         i != count;
+         i = nextCandidate(names, classes, i+1, count, want, cls,
+                           strict_linking_))
+    {
+      // name and class already match
+      if (std::binary_search(searchpath->begin(), searchpath->end(),
+                             table_.dirname[i]))
+        return table_.objects[i];
+      log(Debug, "  skipping %s/%s (not visible)\n",
+          table_.objects[i]->dirname_.c_str(),
+          table_.objects[i]->basename_.c_str());
+    }
+    return 0;
+  }
+
+  for (auto &dir : order) {
+    for (auto &lib : objects_) {
+      if (lib->dirname_ == dir && lib->basename_ == needed &&
+          obj->CanUse(*lib, strict_linking_))
+      {
+        return lib;
+      }
+    }
+  }
+  if (ld_order_)
+    return 0;
+  for (auto &lib : objects_) {
+    if (usable(lib))
+      return lib;
   }
   return 0;
 }
@@ -282,7 +578,18 @@ void DB::LinkObject_do(Elf *obj, const Package *owner) {
 }
 
 void DB::LinkObject(Elf *obj, const Package *owner,
-                    ObjectSet &req_found, StringSet &req_missing) const
+                    ObjectSet &req_found, StringSet &req_missing,
+                    const ObjectIndex *index) const
+{
+  std::vector<Elf*> found;
+  ResolveObject(obj, owner, found, req_missing, index);
+  req_found.insert(found.begin(), found.end());
+}
+
+// Like LinkObject, but appends to a flat list, for the threaded linkers.
+void DB::ResolveObject(const Elf *obj, const Package *owner,
+                       std::vector<Elf*> &req_found, StringSet &req_missing,
+                       const ObjectIndex *index) const
 {
   if (ignore_file_rules_.size()) {
     std::string full = obj->dirname_ + "/" + obj->basename_;
@@ -292,10 +599,18 @@ void DB::LinkObject(Elf *obj, const Package *owner,
 
   const StringList *libpaths = GetPackageLibPath(owner);
 
+  // full scans check visibility against the object's search path
+  DirSet searchpath;
+  const DirSet *dirs = nullptr;
+  if (!index && table_.objects.size()) {
+    SearchPath(obj, libpaths, searchpath);
+    dirs = &searchpath;
+  }
+
   for (auto &needed : obj->needed_) {
-    Elf *found = FindFor (obj, needed, libpaths);
+    Elf *found = FindFor (obj, needed, libpaths, index, dirs);
     if (found)
-      req_found.insert(found);
+      req_found.push_back(found);
     else if (assume_found_rules_.find(needed) == assume_found_rules_.end())
       req_missing.insert(needed);
   }
@@ -331,17 +646,21 @@ namespace thread {
     if (opt_max_jobs >= 1 && opt_max_jobs < threadcount)
       threadcount = opt_max_jobs;
 
+    // queries pass no status printer
+    const bool status = !opt_quiet && StatusPrinter;
+
     unsigned long  obj_per_thread = Count / threadcount;
-    if (!opt_quiet)
+    if (status)
       StatusPrinter(0, Count, threadcount);
 
     if (threadcount == 1) {
+      std::vector<PerThread> Data(1);
       for (unsigned long i = 0; i != Count; ++i) {
-        PerThread Data;
-        Worker(nullptr, i, i+1, Data);
-        if (!opt_quiet)
+        Worker(nullptr, i, i+1, Data[0]);
+        if (status)
           StatusPrinter(i, Count, 1);
       }
+      Merger(std::move(Data));
       return;
     }
 
@@ -366,7 +685,7 @@ namespace thread {
                       &counter,
                       i*obj_per_thread, Count,
                       std::ref(Data[i])));
-    if (!opt_quiet) {
+    if (status) {
       unsigned long c = 0;
       while (c != Count) {
         c = counter.load();
@@ -380,45 +699,69 @@ namespace thread {
       delete threads[i];
     }
     Merger(std::move(Data));
-    if (!opt_quiet)
+    if (status)
       StatusPrinter(Count, Count, threadcount);
   }
 
 } // namespace thread
 
 void DB::RelinkAll_Threaded() {
-  //using FoundMap   = std::map<Elf*, ObjectSet>;
-  //using MissingMap = std::map<Elf*, StringSet>;
-  //using Tuple      = std::tuple<FoundMap, MissingMap>;
-  auto worker = [this](std::atomic_ulong *count, size_t from, size_t to, int&)
+  // Every thread collects its results in flat buffers instead of building
+  // sets for each object, the merger then moves them into the objects.
+  struct Results {
+    std::vector<Elf*>      objects;
+    std::vector<size_t>    found_at; // objects[i] found found[found_at[i]..]
+    std::vector<Elf*>      found;
+    std::vector<StringSet> missing;
+  };
+
+  auto worker = [this](std::atomic_ulong *count, size_t from, size_t to,
+                       Results &res)
   {
-    //FoundMap   *f = &std::get<0>(tup);
-    //MissingMap *m = &std::get<1>(tup);
+    if (res.objects.empty()) {
+      size_t objcount = 0;
+      for (size_t i = from; i != to; ++i)
+        objcount += this->packages_[i]->objects_.size();
+      res.objects.reserve(objcount);
+      res.found_at.reserve(objcount);
+      res.missing.reserve(objcount);
+    }
+
     for (size_t i = from; i != to; ++i) {
       const Package *pkg = this->packages_[i];
 
       for (auto &obj : pkg->objects_) {
-        this->LinkObject_do(obj, pkg);
-        //ObjectSet req_found;
-        //StringSet req_missing;
-        //this->LinkObject(obj, pkg, req_found, req_missing);
-        //(*f)[obj] = std::move(req_found);
-        //(*m)[obj] = std::move(req_missing);
+        size_t at = res.found.size();
+        res.objects.push_back(obj.get());
+        res.found_at.push_back(at);
+        res.missing.emplace_back();
+        this->ResolveObject(obj.get(), pkg, res.found, res.missing.back());
+        // same order and uniqueness as an ObjectSet
+        std::sort(res.found.begin() + at, res.found.end());
+        res.found.erase(std::unique(res.found.begin() + at, res.found.end()),
+                        res.found.end());
       }
 
       if (count && !opt_quiet)
         (*count)++;
     }
   };
-  auto merger = [this](std::vector<int> &&) {
-    //for (auto &t : tup) {
-    //  FoundMap   &found = std::get<0>(t);
-    //  MissingMap &missing = std::get<1>(t);
-    //  for (auto &f : found)
-    //    f.first->req_found = std::move(f.second);
-    //  for (auto &m : missing)
-    //    m.first->req_missing = std::move(m.second);
-    //}
+  auto merger = [](std::vector<Results> &&results) {
+    for (auto &res : results) {
+      res.found_at.push_back(res.found.size());
+      for (size_t i = 0; i != res.objects.size(); ++i) {
+        Elf *obj = res.objects[i];
+        auto from = res.found.begin() + res.found_at[i];
+        auto to   = res.found.begin() + res.found_at[i+1];
+        // leave unchanged sets alone
+        if (obj->req_found_.size() != size_t(to - from) ||
+            !std::equal(from, to, obj->req_found_.begin()))
+        {
+          obj->req_found_ = ObjectSet(from, to);
+        }
+        obj->req_missing_ = std::move(res.missing[i]);
+      }
+    }
   };
   double fac = 100.0 / double(packages_.size());
   unsigned int pc = 1000;
@@ -435,14 +778,121 @@ void DB::RelinkAll_Threaded() {
     if (at == cnt)
       printf("\n");
   };
-  thread::work<int>(packages_.size(), status, worker, merger);
+  thread::work<Results>(packages_.size(), status, worker, merger);
 }
 #endif
 
+// Links the objects added since BeginBatch, and relinks those which either
+// used a removed object or miss a library of the name of an added one.
+// Both the search for those and the linking itself are split up over
+// threads for bigger databases.
+bool DB::Commit() {
+  if (!batch_.active)
+    return true;
+  batch_.active = false;
+
+  ObjectIndex index;
+  for (auto &obj : objects_)
+    index[obj->basename_].push_back(obj);
+
+  StringSet names;
+  for (auto &obj : batch_.added)
+    names.insert(obj->basename_);
+
+  auto needs_link = [this, &names](Elf *obj) {
+    auto &found   = obj->req_found_;
+    auto &missing = obj->req_missing_;
+    return batch_.added.count(obj) ||
+           std::any_of(found.begin(), found.end(),
+                       [this](Elf *lib) {
+                         return batch_.removed.count(lib) != 0;
+                       }) ||
+           std::any_of(missing.begin(), missing.end(),
+                       [&names](const std::string &lib) {
+                         return names.count(lib) != 0;
+                       });
+  };
+
+  std::vector<Elf*> relink;
+#ifdef ENABLE_THREADS
+  if (opt_max_jobs    != 1 &&
+      thread::ncpus   >  1 &&
+      objects_.size() >= 300)
+  {
+    using Linked = std::tuple<Elf*, std::vector<Elf*>, StringSet>;
+
+    // no status printer: work() would poll it every 100ms
+    thread::work<std::vector<Elf*>>(objects_.size(), nullptr,
+      [this, &needs_link](std::atomic_ulong *count, size_t from, size_t to,
+                          std::vector<Elf*> &out)
+      {
+        for (size_t i = from; i != to; ++i) {
+          if (needs_link(objects_[i]))
+            out.push_back(objects_[i]);
+          if (count && !opt_quiet)
+            (*count)++;
+        }
+      },
+      [&relink](std::vector<std::vector<Elf*>> &&parts) {
+        for (auto &part : parts)
+          relink.insert(relink.end(), part.begin(), part.end());
+      });
+
+    thread::work<std::vector<Linked>>(relink.size(), nullptr,
+      [this, &relink, &index](std::atomic_ulong *count, size_t from,
+                              size_t to, std::vector<Linked> &out)
+      {
+        for (size_t i = from; i != to; ++i) {
+          Elf *obj = relink[i];
+          std::vector<Elf*> found;
+          StringSet         missing;
+          ResolveObject(obj, obj->owner_, found, missing, &index);
+          out.emplace_back(obj, std::move(found), std::move(missing));
+          if (count && !opt_quiet)
+            (*count)++;
+        }
+      },
+      [](std::vector<std::vector<Linked>> &&parts) {
+        for (auto &part : parts) {
+          for (auto &linked : part) {
+            Elf *obj = std::get<0>(linked);
+            auto &found = std::get<1>(linked);
+            obj->req_found_   = ObjectSet(found.begin(), found.end());
+            obj->req_missing_ = std::move(std::get<2>(linked));
+          }
+        }
+      });
+
+    batch_.added.clear();
+    batch_.removed.clear();
+    batch_.keep.clear();
+    return true;
+  }
+#endif
+
+  for (auto &obj : objects_) {
+    if (needs_link(obj))
+      relink.push_back(obj);
+  }
+  for (Elf *obj : relink) {
+    obj->req_found_.clear();
+    obj->req_missing_.clear();
+    LinkObject(obj, obj->owner_, obj->req_found_, obj->req_missing_, &index);
+  }
+
+  batch_.added.clear();
+  batch_.removed.clear();
+  batch_.keep.clear();
+  return true;
+}
+
 void DB::RelinkAll() {
   if (!packages_.size())
     return;
 
+  BuildObjectTable();
+  guard drop_table([this]() { table_ = ObjectTable(); });
+
 #ifdef ENABLE_THREADS
   if (opt_max_jobs     != 1   &&
       thread::ncpus    >  1   &&
@@ -687,14 +1137,250 @@ bool DB::BasePackages_Delete(size_t id) {
   return true;
 }
 
+void DB::BuildQueryIndex() {
+  auto sort = [](KeyIndex &index) {
+    std::sort(index.begin(), index.end());
+  };
+  KeyIndex pkgname, group, depends, provides, objname;
+  for (uint32_t i = 0; i != packages_.size(); ++i) {
+    const Package *pkg = packages_[i];
+    pkgname.emplace_back(pkg->name_, i);
+    for (auto &entry : pkg->groups_)
+      group.emplace_back(entry, i);
+    for (auto &entry : pkg->depends_)
+      depends.emplace_back(entry, i);
+    for (auto &entry : pkg->provides_)
+      provides.emplace_back(entry, i);
+  }
+  query_index_.objpos.clear();
+  for (uint32_t i = 0; i != objects_.size(); ++i) {
+    objname.emplace_back(objects_[i]->basename_, i);
+    query_index_.objpos[objects_[i]] = i;
+  }
+  sort(pkgname);
+  sort(group);
+  sort(depends);
+  sort(provides);
+  sort(objname);
+  query_index_.pkgname  = move(pkgname);
+  query_index_.group    = move(group);
+  query_index_.depends  = move(depends);
+  query_index_.provides = move(provides);
+  query_index_.objname  = move(objname);
+  query_index_.valid    = true;
+}
+
+// Positions in an index which a matcher may accept, sorted. Returns false
+// when the matcher gives no key to look up.
+static bool index_lookup(const std::vector<std::pair<std::string,uint32_t>>
+                           &index,
+                         const filter::Match &match,
+                         std::vector<uint32_t> &out)
+{
+  std::string key;
+  bool exact;
+  if (!match.IndexKey(key, exact))
+    return false;
+  out.clear();
+  auto entry = std::lower_bound(index.begin(), index.end(),
+                                std::make_pair(key, uint32_t(0)));
+  for (; entry != index.end(); ++entry) {
+    if (exact ? entry->first != key
+              : entry->first.compare(0, key.length(), key) != 0)
+      break;
+    out.push_back(entry->second);
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return true;
+}
+
+// whether a filter can be answered from the index, so it is only built
+// when there is a use for it
+template<typename FILTER>
+static bool indexable(const FILTER &filt) {
+  std::string key;
+  bool exact;
+  return !filt.negate_ && filt.field_ != FILTER::Field::None &&
+         filt.match_ && filt.match_->IndexKey(key, exact);
+}
+
+template<typename LIST>
+static bool any_indexable(const LIST &filters) {
+  for (auto &filt : filters) {
+    if (indexable(*filt))
+      return true;
+  }
+  return false;
+}
+
+// narrow down the current selection
+static void intersect(std::vector<uint32_t> &selection, bool &selected,
+                      std::vector<uint32_t> &&found)
+{
+  if (!selected) {
+    selection = move(found);
+    selected  = true;
+    return;
+  }
+  std::vector<uint32_t> both;
+  std::set_intersection(selection.begin(), selection.end(),
+                        found.begin(), found.end(),
+                        std::back_inserter(both));
+  selection = move(both);
+}
+
+// Fills the selection from the non-negated package filters which can use
+// the index, returns false if there was none.
+bool DB::PlanPackages(const FilterList &filters,
+                      std::vector<uint32_t> &selection) const
+{
+  using Field = filter::PackageFilter::Field;
+  bool selected = false;
+  std::vector<uint32_t> found;
+  for (auto &filt : filters) {
+    const KeyIndex *index;
+    switch (filt->negate_ ? Field::None : filt->field_) {
+      case Field::Name:     index = &query_index_.pkgname;  break;
+      case Field::Group:    index = &query_index_.group;    break;
+      case Field::Depends:  index = &query_index_.depends;  break;
+      case Field::Provides: index = &query_index_.provides; break;
+      default: continue;
+    }
+    if (index_lookup(*index, *filt->match_, found))
+      intersect(selection, selected, move(found));
+  }
+  return selected;
+}
+
+std::vector<Package*> DB::SelectPackages(const FilterList &filters) {
+  if (!any_indexable(filters))
+    return packages_;
+  if (!query_index_.valid)
+    BuildQueryIndex();
+
+  std::vector<uint32_t> selection;
+  if (!PlanPackages(filters, selection))
+    return packages_;
+
+  std::vector<Package*> out;
+  out.reserve(selection.size());
+  for (uint32_t i : selection)
+    out.push_back(packages_[i]);
+  return out;
+}
+
+std::vector<Elf*> DB::SelectObjects(const FilterList    &pkg_filters,
+                                    const ObjFilterList &obj_filters)
+{
+  auto everything = [this]() {
+    return std::vector<Elf*>(objects_.begin(), objects_.end());
+  };
+  if (!any_indexable(pkg_filters) && !any_indexable(obj_filters))
+    return everything();
+  if (!query_index_.valid)
+    BuildQueryIndex();
+
+  bool selected = false;
+  std::vector<uint32_t> selection, found;
+  for (auto &filt : obj_filters) {
+    if (filt->negate_ || filt->field_ == filter::ObjectFilter::Field::None)
+      continue;
+    if (index_lookup(query_index_.objname, *filt->match_, found))
+      intersect(selection, selected, move(found));
+  }
+
+  // objects of the packages the package filters can narrow down to
+  std::vector<uint32_t> pkgsel;
+  if (PlanPackages(pkg_filters, pkgsel)) {
+    found.clear();
+    for (uint32_t p : pkgsel) {
+      for (auto &obj : packages_[p]->objects_)
+        found.push_back(query_index_.objpos[obj]);
+    }
+    std::sort(found.begin(), found.end());
+    intersect(selection, selected, move(found));
+  }
+
+  if (!selected)
+    return everything();
+  std::vector<Elf*> out;
+  out.reserve(selection.size());
+  for (uint32_t i : selection)
+    out.push_back(objects_[i]);
+  return out;
+}
+
+static void appendf(std::string &out, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string &out, const char *fmt, ...) {
+  char buf[1024];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if ((size_t)len < sizeof(buf)) {
+    out.append(buf, len);
+    return;
+  }
+  size_t at = out.size();
+  out.resize(at + len + 1);
+  va_start(ap, fmt);
+  vsnprintf(&out[at], len + 1, fmt, ap);
+  va_end(ap);
+  out.resize(at + len);
+}
+
+// Formats each entry into an output buffer which is written to stdout in
+// large chunks. Longer lists are split into consecutive ranges formatted
+// on separate threads, and their buffers are written in order.
+template<typename T>
+static void print_all(const std::vector<T> &entries, size_t min_threaded,
+                      std::function<void(const T&, std::string&)> format)
+{
+#ifdef ENABLE_THREADS
+  if (opt_max_jobs != 1 && thread::ncpus > 1 &&
+      entries.size() >= min_threaded)
+  {
+    thread::work<std::string>(entries.size(), nullptr,
+      [&entries,&format](std::atomic_ulong*, size_t from, size_t to,
+                         std::string &out)
+      {
+        for (size_t i = from; i != to; ++i)
+          format(entries[i], out);
+      },
+      [](std::vector<std::string> &&outs) {
+        for (auto &out : outs)
+          fwrite(out.data(), 1, out.length(), stdout);
+      });
+    return;
+  }
+#else
+  (void)min_threaded;
+#endif
+  std::string out;
+  for (auto &entry : entries) {
+    format(entry, out);
+    if (out.length() >= 64*1024) {
+      fwrite(out.data(), 1, out.length(), stdout);
+      out.clear();
+    }
+  }
+  fwrite(out.data(), 1, out.length(), stdout);
+}
+
 void DB::ShowInfo() {
   if (opt_json & JSONBits::Query)
     return ShowInfo_json();
 
   printf("DB version: %u\n", loaded_version_);
   printf("DB name:    [%s]\n", name_.c_str());
-  printf("DB flags:   { %s }\n",
-         (strict_linking_ ? "strict" : "non_strict"));
+  printf("DB flags:   { %s%s }\n",
+         (strict_linking_ ? "strict" : "non_strict"),
+         (ld_order_ ? ", ld_order" : ""));
   printf("Additional Library Paths:\n");
   unsigned id = 0;
   for (auto &p : library_path_)
@@ -742,6 +1428,55 @@ bool DB::IsEmpty(const Package *pkg, const ObjFilterList &filters) const {
   return vis == 0;
 }
 
+// Resolve the object's imported symbols against everything the dynamic
+// linker would load for it: the breadth first closure over req_found_.
+// Returns false when there's nothing missing, or when the answer cannot
+// be known because some part of the closure has no symbol information
+// or a library is missing or only assumed to exist.
+bool DB::MissingSymbols(const Elf *obj, SymbolList &missing) const {
+  missing.clear();
+  if (obj->sym_imports_.empty() || !obj->req_missing_.empty())
+    return false;
+  if (ignore_file_rules_.size()) {
+    std::string full = obj->dirname_ + "/" + obj->basename_;
+    if (ignore_file_rules_.find(full) != ignore_file_rules_.end())
+      return false;
+  }
+  for (auto &needed : obj->needed_) {
+    if (assume_found_rules_.find(needed) != assume_found_rules_.end())
+      return false;
+  }
+
+  std::vector<const Elf*> loadset;
+  std::set<const Elf*>    seen;
+  for (auto &lib : obj->req_found_) {
+    if (seen.insert(lib).second)
+      loadset.push_back(lib);
+  }
+
+  // both lists are sorted, so each library is one linear merge which
+  // only keeps the symbols it does not export
+  missing = obj->sym_imports_;
+  SymbolList rest;
+  for (size_t i = 0; i != loadset.size() && !missing.empty(); ++i) {
+    const Elf *lib = loadset[i];
+    if (lib->sym_exports_.empty() || !lib->req_missing_.empty()) {
+      missing.clear();
+      return false;
+    }
+    rest.clear();
+    std::set_difference(missing.begin(), missing.end(),
+                        lib->sym_exports_.begin(), lib->sym_exports_.end(),
+                        std::back_inserter(rest));
+    missing.swap(rest);
+    for (auto &dep : lib->req_found_) {
+      if (seen.insert(dep).second)
+        loadset.push_back(dep);
+    }
+  }
+  return !missing.empty();
+}
+
 bool DB::IsBroken(const Package *pkg) const {
   for (auto &obj : pkg->objects_) {
     if (IsBroken(obj))
@@ -755,13 +1490,16 @@ void DB::ShowPackages(bool                 filter_broken,
                       const FilterList    &pkg_filters,
                       const ObjFilterList &obj_filters)
 {
+  if (opt_output != OutputFormat::Text)
+    return ShowPackages_records(filter_broken, filter_notempty,
+                                pkg_filters, obj_filters);
   if (opt_json & JSONBits::Query)
     return ShowPackages_json(filter_broken, filter_notempty,
                              pkg_filters, obj_filters);
 
   if (!opt_quiet)
     printf("Packages:%s\n", (filter_broken ? " (filter: 'broken')" : ""));
-  for (auto &pkg : packages_) {
+  for (auto &pkg : SelectPackages(pkg_filters)) {
     if (!util::all(pkg_filters, *this, *pkg))
       continue;
     if (filter_broken && !IsBroken(pkg))
@@ -814,6 +1552,8 @@ void DB::ShowPackages(bool                 filter_broken,
 void DB::ShowObjects(const FilterList    &pkg_filters,
                      const ObjFilterList &obj_filters)
 {
+  if (opt_output != OutputFormat::Text)
+    return ShowObjects_records(pkg_filters, obj_filters);
   if (opt_json & JSONBits::Query)
     return ShowObjects_json(pkg_filters, obj_filters);
 
@@ -824,43 +1564,48 @@ void DB::ShowObjects(const FilterList    &pkg_filters,
   }
   if (!opt_quiet)
     printf("Objects:\n");
-  for (auto &obj : objects_) {
+  print_all<Elf*>(SelectObjects(pkg_filters, obj_filters), 1024,
+                  [&](Elf *const &obj, std::string &out)
+  {
     if (!util::all(obj_filters, *this, *obj))
-      continue;
+      return;
     if (pkg_filters.size() &&
         (!obj->owner_ || !util::all(pkg_filters, *this, *obj->owner_)))
-      continue;
+      return;
     if (opt_quiet)
-      printf("%s/%s\n", obj->dirname_.c_str(), obj->basename_.c_str());
+      appendf(out, "%s/%s\n", obj->dirname_.c_str(), obj->basename_.c_str());
     else
-      printf("  -> %s / %s\n", obj->dirname_.c_str(), obj->basename_.c_str());
+      appendf(out, "  -> %s / %s\n",
+              obj->dirname_.c_str(), obj->basename_.c_str());
     if (opt_verbosity < 1)
-      continue;
-    printf("     class: %u (%s)\n"
-           "     data:  %u (%s)\n"
-           "     osabi: %u (%s)\n",
-           (unsigned)obj->ei_class_, obj->classString(),
-           (unsigned)obj->ei_data_,  obj->dataString(),
-           (unsigned)obj->ei_osabi_, obj->osabiString());
+      return;
+    appendf(out, "     class: %u (%s)\n"
+                 "     data:  %u (%s)\n"
+                 "     osabi: %u (%s)\n",
+            (unsigned)obj->ei_class_, obj->classString(),
+            (unsigned)obj->ei_data_,  obj->dataString(),
+            (unsigned)obj->ei_osabi_, obj->osabiString());
     if (obj->rpath_set_)
-      printf("     rpath: %s\n", obj->rpath_.c_str());
+      appendf(out, "     rpath: %s\n", obj->rpath_.c_str());
     if (obj->runpath_set_)
-      printf("     runpath: %s\n", obj->runpath_.c_str());
+      appendf(out, "     runpath: %s\n", obj->runpath_.c_str());
     if (opt_verbosity < 2)
-      continue;
-    printf("     finds:\n"); {
+      return;
+    out.append("     finds:\n"); {
       for (auto &found : obj->req_found_)
-        printf("       -> %s / %s\n",
-               found->dirname_.c_str(), found->basename_.c_str());
+        appendf(out, "       -> %s / %s\n",
+                found->dirname_.c_str(), found->basename_.c_str());
     }
-    printf("     misses:\n"); {
+    out.append("     misses:\n"); {
       for (auto &miss : obj->req_missing_)
-        printf("       -> %s\n", miss.c_str());
+        appendf(out, "       -> %s\n", miss.c_str());
     }
-  }
+  });
 }
 
 void DB::ShowMissing() {
+  if (opt_output != OutputFormat::Text)
+    return ShowMissing_records();
   if (opt_json & JSONBits::Query)
     return ShowMissing_json();
 
@@ -880,6 +1625,8 @@ void DB::ShowMissing() {
 }
 
 void DB::ShowFound() {
+  if (opt_output != OutputFormat::Text)
+    return ShowFound_records();
   if (opt_json & JSONBits::Query)
     return ShowFound_json();
 
@@ -900,19 +1647,58 @@ void DB::ShowFound() {
 void DB::ShowFilelist(const FilterList    &pkg_filters,
                       const StrFilterList &str_filters)
 {
+  if (opt_output != OutputFormat::Text)
+    return ShowFilelist_records(pkg_filters, str_filters);
   if (opt_json & JSONBits::Query)
     return ShowFilelist_json(pkg_filters, str_filters);
 
-  for (auto &pkg : packages_) {
+  print_all<Package*>(SelectPackages(pkg_filters), 16,
+                      [&](Package *const &pkg, std::string &out)
+  {
     if (!util::all(pkg_filters, *this, *pkg))
-      continue;
-    for (auto &file : pkg->filelist_) {
-      if (!util::all(str_filters, file))
+      return;
+    std::vector<uint64_t> shown;
+    filter::StringFilter::Select(str_filters, pkg->filelist_, shown);
+    for (size_t i = 0; i != pkg->filelist_.size(); ++i) {
+      if (!(shown[i/64] & (uint64_t(1) << (i%64))))
         continue;
-      if (!opt_quiet)
-        printf("%s ", pkg->name_.c_str());
-      printf("%s\n", file.c_str());
+      const std::string &file = pkg->filelist_[i];
+      if (!opt_quiet) {
+        out.append(pkg->name_);
+        out.append(1, ' ');
+      }
+      out.append(file);
+      out.append(1, '\n');
     }
+  });
+}
+
+void DB::ShowMissingSymbols(const FilterList    &pkg_filters,
+                            const ObjFilterList &obj_filters)
+{
+  if (opt_json & JSONBits::Query)
+    return ShowMissingSymbols_json(pkg_filters, obj_filters);
+
+  if (!contains_symbols_)
+    log(Warn, "the database contains no symbol information\n");
+
+  if (!opt_quiet)
+    printf("Missing symbols:\n");
+  SymbolList missing;
+  for (Elf *obj : SelectObjects(pkg_filters, obj_filters)) {
+    if (!util::all(obj_filters, *this, *obj))
+      continue;
+    if (pkg_filters.size() &&
+        (!obj->owner_ || !util::all(pkg_filters, *this, *obj->owner_)))
+      continue;
+    if (!MissingSymbols(obj, missing))
+      continue;
+    if (opt_quiet)
+      printf("%s/%s\n", obj->dirname_.c_str(), obj->basename_.c_str());
+    else
+      printf("  -> %s / %s\n", obj->dirname_.c_str(), obj->basename_.c_str());
+    for (auto id : missing)
+      printf("    misses symbol: %s\n", symbols::Name(id).c_str());
   }
 }
 
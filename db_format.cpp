@@ -14,7 +14,7 @@
 
 // version
 uint16_t
-DB::CURRENT = 8;
+DB::CURRENT = 11;
 
 // magic header
 static const char
@@ -30,7 +30,11 @@ namespace DBFlags {
     BasePackages  = (1<<2),
     StrictLinking = (1<<3),
     AssumeFound   = (1<<4),
-    FileLists     = (1<<5)
+    FileLists     = (1<<5),
+    Symbols       = (1<<6),
+    ObjectHashes  = (1<<7),
+    PkgArchives   = (1<<8),
+    LDOrder       = (1<<9)
   };
 }
 
@@ -281,7 +285,9 @@ bool read_objset(SerialIn &in, ObjectSet& list) {
     rptr<Elf> obj;
     if (!read_obj(in, obj))
       return false;
-    list.insert(obj);
+    // an object no package owns can't be linked against
+    if (obj->owner_)
+      list.insert(obj);
   }
 #endif
   return in.in_;
@@ -394,6 +400,7 @@ static bool read_obj(SerialIn &in, rptr<Elf> &obj) {
 
   // Remember the one we're constructing now:
   obj = new Elf;
+  in.created_.push_back(obj);
   if (in.ver8_refs_)
     in.objref_.push_back(obj.get());
   else {
@@ -536,6 +543,165 @@ static bool read_pkg(SerialIn &in,     Package  *&pkg,
   return true;
 }
 
+// The symbol IDs are only valid within this process, so the DB stores
+// the names which are in use once and refers to them by their index.
+static bool write_symlist(SerialOut &out, const SymbolList &list,
+                          const std::vector<uint32_t> &index)
+{
+  std::vector<uint32_t> refs;
+  refs.reserve(list.size());
+  for (auto id : list)
+    refs.push_back(index[id]);
+  out <= static_cast<uint32_t>(refs.size());
+  if (refs.size())
+    out.out_.Write(&refs[0], refs.size() * sizeof(refs[0]));
+  return out.out_;
+}
+
+static bool read_symlist(SerialIn &in, SymbolList &list,
+                         const SymbolList &table)
+{
+  uint32_t len;
+  in >= len;
+  list.resize(len);
+  if (!len)
+    return in.in_;
+  in.in_.Read(&list[0], len * sizeof(list[0]));
+  for (auto &id : list) {
+    if (id >= table.size()) {
+      log(Error, "db error: symbol index out of range\n");
+      return false;
+    }
+    id = table[id];
+  }
+  // the process-local IDs may be ordered differently
+  std::sort(list.begin(), list.end());
+  return in.in_;
+}
+
+static bool write_symbols(SerialOut &out, const DB *db) {
+  std::vector<uint32_t> index(symbols::Count(), uint32_t(-1));
+  SymbolList            table;
+  uint32_t              count = 0;
+  auto add = [&index,&table](const SymbolList &list) {
+    for (auto id : list) {
+      if (index[id] != uint32_t(-1))
+        continue;
+      index[id] = static_cast<uint32_t>(table.size());
+      table.push_back(id);
+    }
+  };
+  for (Elf *obj : db->objects_) {
+    if (obj->sym_imports_.empty() && obj->sym_exports_.empty())
+      continue;
+    add(obj->sym_imports_);
+    add(obj->sym_exports_);
+    ++count;
+  }
+
+  out <= static_cast<uint32_t>(table.size());
+  for (auto id : table)
+    out <= symbols::Name(id);
+
+  out <= count;
+  for (Elf *obj : db->objects_) {
+    if (obj->sym_imports_.empty() && obj->sym_exports_.empty())
+      continue;
+    if (!write_obj(out, obj) ||
+        !write_symlist(out, obj->sym_imports_, index) ||
+        !write_symlist(out, obj->sym_exports_, index))
+    {
+      return false;
+    }
+  }
+  return out.out_;
+}
+
+static bool read_symbols(SerialIn &in) {
+  uint32_t len;
+  in >= len;
+  SymbolList  table(len);
+  std::string name;
+  for (uint32_t i = 0; i != len; ++i) {
+    in >= name;
+    table[i] = symbols::Intern(name.c_str(), name.length());
+  }
+
+  in >= len;
+  rptr<Elf> obj;
+  for (uint32_t i = 0; i != len; ++i) {
+    if (!read_obj(in, obj) ||
+        !read_symlist(in, obj->sym_imports_, table) ||
+        !read_symlist(in, obj->sym_exports_, table))
+    {
+      return false;
+    }
+  }
+  return in.in_;
+}
+
+static bool write_hashes(SerialOut &out, const DB *db) {
+  uint32_t count = 0;
+  for (Elf *obj : db->objects_) {
+    if (obj->content_hash_)
+      ++count;
+  }
+  out <= count;
+  for (Elf *obj : db->objects_) {
+    if (!obj->content_hash_)
+      continue;
+    if (!write_obj(out, obj))
+      return false;
+    out <= obj->content_hash_;
+  }
+  return out.out_;
+}
+
+static bool read_hashes(SerialIn &in) {
+  uint32_t len;
+  in >= len;
+  rptr<Elf> obj;
+  for (uint32_t i = 0; i != len; ++i) {
+    if (!read_obj(in, obj))
+      return false;
+    in >= obj->content_hash_;
+  }
+  return in.in_;
+}
+
+static bool write_archives(SerialOut &out, const DB *db) {
+  uint32_t count = 0;
+  for (Package *pkg : db->packages_) {
+    if (pkg->archive_name_.length())
+      ++count;
+  }
+  out <= count;
+  for (Package *pkg : db->packages_) {
+    if (!pkg->archive_name_.length())
+      continue;
+    if (!write_pkg(out, pkg, DB::CURRENT, 0))
+      return false;
+    out <= pkg->archive_name_
+        <= pkg->archive_size_
+        <= pkg->archive_mtime_;
+  }
+  return out.out_;
+}
+
+static bool read_archives(SerialIn &in) {
+  uint32_t len;
+  in >= len;
+  Package *pkg;
+  for (uint32_t i = 0; i != len; ++i) {
+    if (!read_pkg(in, pkg, DB::CURRENT, 0))
+      return false;
+    in >= pkg->archive_name_
+       >= pkg->archive_size_
+       >= pkg->archive_mtime_;
+  }
+  return in.in_;
+}
+
 static inline bool ends_with_gz(const std::string& str) {
   size_t pos = str.find_last_of('.');
   return (pos == str.length()-3 &&
@@ -573,13 +739,35 @@ static bool db_store(DB *db, const std::string& filename) {
     hdr.flags |= DBFlags::BasePackages;
   if (db->strict_linking_)
     hdr.flags |= DBFlags::StrictLinking;
+  if (db->ld_order_)
+    hdr.flags |= DBFlags::LDOrder;
   if (db->assume_found_rules_.size())
     hdr.flags |= DBFlags::AssumeFound;
   if (db->contains_filelists_)
     hdr.flags |= DBFlags::FileLists;
+  if (db->contains_symbols_)
+    hdr.flags |= DBFlags::Symbols;
+  for (Elf *obj : db->objects_) {
+    if (obj->content_hash_) {
+      hdr.flags |= DBFlags::ObjectHashes;
+      break;
+    }
+  }
+  for (Package *pkg : db->packages_) {
+    if (pkg->archive_name_.length()) {
+      hdr.flags |= DBFlags::PkgArchives;
+      break;
+    }
+  }
 
   // Figure out which database format version this will be
-  if (hdr.flags & DBFlags::FileLists)
+  if (hdr.flags & DBFlags::PkgArchives)
+    hdr.version = 11;
+  else if (hdr.flags & DBFlags::ObjectHashes)
+    hdr.version = 10;
+  else if (hdr.flags & DBFlags::Symbols)
+    hdr.version = 9;
+  else if (hdr.flags & DBFlags::FileLists)
     hdr.version = 7;
   else if (hdr.flags & DBFlags::AssumeFound)
     hdr.version = 6;
@@ -663,6 +851,21 @@ static bool db_store(DB *db, const std::string& filename) {
       return false;
   }
 
+  if (hdr.flags & DBFlags::Symbols) {
+    if (!write_symbols(out, db))
+      return false;
+  }
+
+  if (hdr.flags & DBFlags::ObjectHashes) {
+    if (!write_hashes(out, db))
+      return false;
+  }
+
+  if (hdr.flags & DBFlags::PkgArchives) {
+    if (!write_archives(out, db))
+      return false;
+  }
+
   return out.out_;
 }
 
@@ -707,6 +910,8 @@ static bool db_read(DB *db, const std::string& filename) {
     db->contains_groups_ = true;
   if (hdr.flags & DBFlags::FileLists)
     db->contains_filelists_ = true;
+  if (hdr.flags & DBFlags::LDOrder)
+    db->ld_order_ = true;
 
   in >= db->name_;
   if (!read_stringlist(in, db->library_path_)) {
@@ -778,6 +983,28 @@ static bool db_read(DB *db, const std::string& filename) {
       return false;
   }
 
+  if (hdr.flags & DBFlags::Symbols) {
+    if (!read_symbols(in)) {
+      log(Error, "failed reading symbol tables\n");
+      return false;
+    }
+    db->contains_symbols_ = true;
+  }
+
+  if (hdr.flags & DBFlags::ObjectHashes) {
+    if (!read_hashes(in)) {
+      log(Error, "failed reading object hashes\n");
+      return false;
+    }
+  }
+
+  if (hdr.flags & DBFlags::PkgArchives) {
+    if (!read_archives(in)) {
+      log(Error, "failed reading package archive info\n");
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -788,10 +1015,24 @@ bool DB::Store(const std::string& filename) {
   return db_store(this, filename);
 }
 
+// databases stored with -J db start with a '{' instead of the magic
+static bool is_json_db(const std::string& filename) {
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (!file)
+    return false;
+  int c;
+  while ((c = fgetc(file)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+    ;
+  fclose(file);
+  return c == '{';
+}
+
 bool DB::Read(const std::string& filename) {
   if (!Empty()) {
     log(Error, "internal usage error: DB::read on a non-empty db!\n");
     return false;
   }
+  if (is_json_db(filename))
+    return db_read_json(this, filename);
   return db_read(this, filename);
 }
@@ -35,6 +35,9 @@ class SerialIn {
   std::vector<Package*>         pkgref_;
   // whether objref and pkgref are used
   bool                          ver8_refs_;
+  // every object read so far: objref_ and old_objref_ point to them,
+  // the ones no package owns are freed along with the reader
+  ObjectList                    created_;
 
  private:
   SerialIn(DB*, SerialStream*);
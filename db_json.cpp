@@ -1,36 +1,147 @@
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 #include "main.h"
 
-static void json_in_quote(FILE *out, const std::string& str) {
-  for (size_t i = 0; i != str.length(); ++i) {
-    switch (str[i]) {
-      case '"':  fputc('\\', out); fputc('"', out); break;
-      case '\\': fputc('\\', out); fputc('\\', out); break;
-      case '\b': fputc('\\', out); fputc('b', out); break;
-      case '\f': fputc('\\', out); fputc('f', out); break;
-      case '\n': fputc('\\', out); fputc('n', out); break;
-      case '\r': fputc('\\', out); fputc('r', out); break;
-      case '\t': fputc('\\', out); fputc('t', out); break;
+// Collects the json text in a buffer which is written out in large
+// blocks, strings are escaped in runs instead of byte by byte.
+class JsonOut {
+ public:
+  explicit JsonOut(FILE *file) : file_(file) {
+    buf_.reserve(block_size + 4096);
+  }
+  ~JsonOut() { flush(); }
+
+  void flush() {
+    if (buf_.length())
+      fwrite(buf_.data(), 1, buf_.length(), file_);
+    buf_.clear();
+  }
+
+  void put(char c) {
+    buf_.push_back(c);
+  }
+  void put(const char *str) {
+    buf_.append(str);
+    check();
+  }
+  void put(const std::string &str) {
+    buf_.append(str);
+    check();
+  }
+
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  void in_quote(const std::string&);
+  void quote(const std::string &str) {
+    buf_.push_back('"');
+    in_quote(str);
+    buf_.push_back('"');
+    check();
+  }
+
+ private:
+  static const size_t block_size = 64 * 1024;
+
+  FILE        *file_;
+  std::string  buf_;
+
+  void check() {
+    if (buf_.length() >= block_size)
+      flush();
+  }
+};
+
+void JsonOut::printf(const char *fmt, ...) {
+  char buf[1024];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if ((size_t)len < sizeof(buf)) {
+    buf_.append(buf, len);
+  } else {
+    size_t at = buf_.size();
+    buf_.resize(at + len + 1);
+    va_start(ap, fmt);
+    vsnprintf(&buf_[at], len + 1, fmt, ap);
+    va_end(ap);
+    buf_.resize(at + len);
+  }
+  check();
+}
+
+// length of the run at the start of str which needs no escaping
+static size_t json_plain(const char *str, size_t length) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctrl   = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+    __m128i special = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+      _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl)); // v <= 0x1F
+    int bits = _mm_movemask_epi8(special);
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+#endif
+  for (; i != length; ++i) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\' || c < 0x20)
+      break;
+  }
+  return i;
+}
+
+static void json_escape(std::string &out, const std::string &str) {
+  const char *data = str.data();
+  const size_t length = str.length();
+  size_t i = 0;
+  while (i != length) {
+    size_t plain = json_plain(data + i, length - i);
+    out.append(data + i, plain);
+    i += plain;
+    if (i == length)
+      break;
+    switch (data[i]) {
+      case '"':  out.append("\\\""); break;
+      case '\\': out.append("\\\\"); break;
+      case '\b': out.append("\\b"); break;
+      case '\f': out.append("\\f"); break;
+      case '\n': out.append("\\n"); break;
+      case '\r': out.append("\\r"); break;
+      case '\t': out.append("\\t"); break;
       default:
-        fputc(str[i], out);
+        out.push_back(data[i]);
         break;
     }
+    ++i;
   }
 }
 
-static void json_quote(FILE *out, const std::string& str) {
-  fprintf(out, "\"");
-  json_in_quote(out, str);
-  fprintf(out, "\"");
+void JsonOut::in_quote(const std::string &str) {
+  json_escape(buf_, str);
 }
 
-static void print_objname(const Elf *obj) {
-  putchar('"');
-  json_in_quote(stdout, obj->dirname_);
-  putchar('/');
-  json_in_quote(stdout, obj->basename_);
-  putchar('"');
+static void print_objname(JsonOut &out, const Elf *obj) {
+  out.put('"');
+  out.in_quote(obj->dirname_);
+  out.put('/');
+  out.in_quote(obj->basename_);
+  out.put('"');
 }
 
 void DB::ShowPackages_json(bool                filter_broken,
@@ -38,62 +149,63 @@ void DB::ShowPackages_json(bool                filter_broken,
                            const FilterList   &pkg_filters,
                            const ObjFilterList &obj_filters)
 {
-  printf("{");
+  JsonOut out(stdout);
+  out.put("{");
   if (filter_broken)
-    printf("\n\t\"filters\": [ \"broken\" ],");
+    out.put("\n\t\"filters\": [ \"broken\" ],");
   else
-    printf("\n\t\"filters\": [],");
+    out.put("\n\t\"filters\": [],");
 
   if (!packages_.size()) {
-    printf("\n\t\"packages\": []\n}\n");
+    out.put("\n\t\"packages\": []\n}\n");
     return;
   }
 
-  printf("\n\t\"packages\": [");
+  out.put("\n\t\"packages\": [");
 
   const char *mainsep = "\n\t\t";
-  for (auto &pkg : packages_) {
+  for (auto &pkg : SelectPackages(pkg_filters)) {
     if (!util::all(pkg_filters, *this, *pkg))
       continue;
     if (filter_broken && !IsBroken(pkg))
       continue;
     if (filter_notempty && IsEmpty(pkg, obj_filters))
       continue;
-    printf("%s{", mainsep); mainsep = ",\n\t\t";
-    printf("\n\t\t\t\"name\": ");
-    json_quote(stdout, pkg->name_);
-    printf(",\n\t\t\t\"version\": ");
-    json_quote(stdout, pkg->version_);
+    out.printf("%s{", mainsep); mainsep = ",\n\t\t";
+    out.put("\n\t\t\t\"name\": ");
+    out.quote(pkg->name_);
+    out.put(",\n\t\t\t\"version\": ");
+    out.quote(pkg->version_);
     if (opt_verbosity >= 1) {
       if (pkg->groups_.size()) {
-        printf(",\n\t\t\t\"groups\": [");
+        out.put(",\n\t\t\t\"groups\": [");
         const char *sep = "\n\t\t\t\t";
         for (auto &grp : pkg->groups_) {
-          printf("%s", sep); sep = ",\n\t\t\t\t";
-          json_quote(stdout, grp);
+          out.put(sep); sep = ",\n\t\t\t\t";
+          out.quote(grp);
         }
-        printf("\n\t\t\t]");
+        out.put("\n\t\t\t]");
       }
       if (pkg->depends_.size()) {
-        printf(",\n\t\t\t\"depends\": [");
+        out.put(",\n\t\t\t\"depends\": [");
         const char *sep = "\n\t\t\t\t";
         for (auto &dep : pkg->depends_) {
-          printf("%s", sep); sep = ",\n\t\t\t\t";
-          json_quote(stdout, dep);
+          out.put(sep); sep = ",\n\t\t\t\t";
+          out.quote(dep);
         }
-        printf("\n\t\t\t]");
+        out.put("\n\t\t\t]");
       }
       if (pkg->optdepends_.size()) {
-        printf(",\n\t\t\t\"optdepends\": [");
+        out.put(",\n\t\t\t\"optdepends\": [");
         const char *sep = "\n\t\t\t\t";
         for (auto &dep : pkg->optdepends_) {
-          printf("%s", sep); sep = ",\n\t\t\t\t";
-          json_quote(stdout, dep);
+          out.put(sep); sep = ",\n\t\t\t\t";
+          out.quote(dep);
         }
-        printf("\n\t\t\t]");
+        out.put("\n\t\t\t]");
       }
       if (filter_broken) {
-        printf(",\n\t\t\t\"broken\": [");
+        out.put(",\n\t\t\t\"broken\": [");
         const char *sep = "\n\t\t\t\t";
         for (auto &obj : pkg->objects_) {
           if (!util::all(obj_filters, *this, *obj))
@@ -101,310 +213,314 @@ void DB::ShowPackages_json(bool                filter_broken,
           if (!IsBroken(obj))
             continue;
           if (opt_verbosity >= 2) {
-            printf("%s{", sep); sep = ",\n\t\t\t\t";
-            printf("\n\t\t\t\t\t\"object\": ");
-            print_objname(obj);
+            out.printf("%s{", sep); sep = ",\n\t\t\t\t";
+            out.put("\n\t\t\t\t\t\"object\": ");
+            print_objname(out, obj);
             auto& list = obj->req_missing_;
             if (!list.empty()) {
-              printf(",\n\t\t\t\t\t\"misses\": [");
+              out.put(",\n\t\t\t\t\t\"misses\": [");
               const char *missep = "\n\t\t\t\t\t\t";
               for (auto &missing : list) {
-                printf("%s", missep);
+                out.put(missep);
                 missep = ",\n\t\t\t\t\t\t";
-                json_quote(stdout, missing);
+                out.quote(missing);
               }
-              printf("\n\t\t\t\t\t]");
+              out.put("\n\t\t\t\t\t]");
             }
-            printf("\n\t\t\t\t}");
+            out.put("\n\t\t\t\t}");
           } else {
-            printf("%s", sep); sep = ",\n\t\t\t\t";
-            print_objname(obj);
+            out.put(sep); sep = ",\n\t\t\t\t";
+            print_objname(out, obj);
           }
         }
-        printf("\n\t\t\t]");
+        out.put("\n\t\t\t]");
       }
       else {
         if (!pkg->objects_.size())
-          printf(",\n\t\t\t\"contains\": []");
+          out.put(",\n\t\t\t\"contains\": []");
         else {
-          printf(",\n\t\t\t\"contains\": [");
+          out.put(",\n\t\t\t\"contains\": [");
           const char *sep = "\n\t\t\t\t";
           for (auto &obj : pkg->objects_) {
             if (!util::all(obj_filters, *this, *obj))
               continue;
-            printf("%s", sep); sep = ",\n\t\t\t\t";
-            print_objname(obj);
+            out.put(sep); sep = ",\n\t\t\t\t";
+            print_objname(out, obj);
           }
-          printf("\n\t\t\t]");
+          out.put("\n\t\t\t]");
         }
       }
     }
-    printf("\n\t\t}");
+    out.put("\n\t\t}");
   }
 
-  printf("\n\t]\n}\n");
+  out.put("\n\t]\n}\n");
 }
 
 void DB::ShowInfo_json() {
-  printf("{");
-  printf( "\n\t\"db_version\": %u", (unsigned)loaded_version_);
-  printf(",\n\t\"db_name\": "); json_quote(stdout, name_);
-  printf(",\n\t\"strict\": %s", (strict_linking_ ? "true" : "false"));
-  printf(",\n\t\"library_path\": [");
+  JsonOut out(stdout);
+  out.put("{");
+  out.printf( "\n\t\"db_version\": %u", (unsigned)loaded_version_);
+  out.put(",\n\t\"db_name\": "); out.quote(name_);
+  out.printf(",\n\t\"strict\": %s", (strict_linking_ ? "true" : "false"));
+  out.printf(",\n\t\"ld_order\": %s", (ld_order_ ? "true" : "false"));
+  out.put(",\n\t\"library_path\": [");
   if (!library_path_.size()) {
-    printf("]\n}\n");
+    out.put("]\n}\n");
     return;
   }
   size_t i = 0;
   while (i != library_path_.size()) {
-    printf("\n\t\t");
-    json_quote(stdout, library_path_[i]);
+    out.put("\n\t\t");
+    out.quote(library_path_[i]);
     if (++i != library_path_.size()) {
-      printf(" // %u", (unsigned)i);
+      out.printf(" // %u", (unsigned)i);
       break;
     }
-    printf(", // %u", (unsigned)(i-1));
+    out.printf(", // %u", (unsigned)(i-1));
   }
-  printf("\n\t]");
+  out.put("\n\t]");
 
   unsigned id;
   if (ignore_file_rules_.size()) {
-    printf(",\n\t\"ignore_files\": [");
+    out.put(",\n\t\"ignore_files\": [");
     id = 0;
     for (auto &p : ignore_file_rules_) {
-      printf("\n\t\t");
-      json_quote(stdout, p);
+      out.put("\n\t\t");
+      out.quote(p);
       if (id+1 == ignore_file_rules_.size())
-        printf(" // %u", id++);
+        out.printf(" // %u", id++);
       else
-        printf(", // %u", id++);
+        out.printf(", // %u", id++);
     }
-    printf("\n\t]");
+    out.put("\n\t]");
   }
   if (assume_found_rules_.size()) {
-    printf(",\n\t\"assume_found\": [");
+    out.put(",\n\t\"assume_found\": [");
     id = 0;
     for (auto &p : assume_found_rules_) {
-      printf("\n\t\t");
-      json_quote(stdout, p);
+      out.put("\n\t\t");
+      out.quote(p);
       if (id+1 == assume_found_rules_.size())
-        printf(" // %u", id++);
+        out.printf(" // %u", id++);
       else
-        printf(", // %u", id++);
+        out.printf(", // %u", id++);
     }
-    printf("\n\t]");
+    out.put("\n\t]");
   }
   const char *sep;
   if (package_library_path_.size()) {
-    printf(",\n\t\"package_libray_paths\": {");
+    out.put(",\n\t\"package_libray_paths\": {");
     sep = "\n\t\t";
     for (auto &iter : package_library_path_) {
-      printf("%s", sep); sep = ",\n\t\t";
-      json_quote(stdout, iter.first);
-      printf(": [");
+      out.put(sep); sep = ",\n\t\t";
+      out.quote(iter.first);
+      out.put(": [");
       const char *psep = "\n\t\t\t";
       for (auto &path : iter.second) {
-        printf("%s", psep); psep = ",\n\t\t\t";
-        json_quote(stdout, path);
+        out.put(psep); psep = ",\n\t\t\t";
+        out.quote(path);
       }
-      printf("\n\t\t]");
+      out.put("\n\t\t]");
     }
-    printf("\n\t}");
+    out.put("\n\t}");
   }
   if (base_packages_.size()) {
-    printf(",\n\t\"base_packages\": [");
+    out.put(",\n\t\"base_packages\": [");
     id = 0;
     for (auto &p : base_packages_) {
-      printf("\n\t\t");
-      json_quote(stdout, p);
+      out.put("\n\t\t");
+      out.quote(p);
       if (id+1 == base_packages_.size())
-        printf(" // %u", id++);
+        out.printf(" // %u", id++);
       else
-        printf(", // %u", id++);
+        out.printf(", // %u", id++);
     }
-    printf("\n\t]");
+    out.put("\n\t]");
   }
 
-  printf("\n}\n");
+  out.put("\n}\n");
 }
 
 void DB::ShowObjects_json(const FilterList    &pkg_filters,
                           const ObjFilterList &obj_filters)
 {
+  JsonOut out(stdout);
   if (!objects_.size()) {
-    printf("{ \"objects\": [] }\n");
+    out.put("{ \"objects\": [] }\n");
     return;
   }
 
-  printf("{ \"objects\": [");
+  out.put("{ \"objects\": [");
   const char *mainsep = "\n\t";
-  for (auto &obj : objects_) {
+  for (auto &obj : SelectObjects(pkg_filters, obj_filters)) {
     if (!util::all(obj_filters, *this, *obj))
       continue;
     if (pkg_filters.size() &&
         (!obj->owner_ || !util::all(pkg_filters, *this, *obj->owner_)))
       continue;
-    printf("%s{\n\t\t\"file\":  ", mainsep); mainsep = ",\n\t";
-    print_objname(obj);
+    out.printf("%s{\n\t\t\"file\":  ", mainsep); mainsep = ",\n\t";
+    print_objname(out, obj);
     if (opt_verbosity < 1) {
-      printf("\n\t}");
+      out.put("\n\t}");
       continue;
     }
     do {
-      printf("\n\t\t\"class\": %u, // %s"
+      out.printf("\n\t\t\"class\": %u, // %s"
              "\n\t\t\"data\":  %u, // %s",
              (unsigned)obj->ei_class_, obj->classString(),
              (unsigned)obj->ei_data_,  obj->dataString());
       if (opt_verbosity >= 2 || obj->rpath_set_ || obj->runpath_set_) {
-        printf("\n\t\t\"osabi\": %u, // %s",
+        out.printf("\n\t\t\"osabi\": %u, // %s",
                (unsigned)obj->ei_osabi_, obj->osabiString());
       } else {
-        printf("\n\t\t\"osabi\": %u  // %s",
+        out.printf("\n\t\t\"osabi\": %u  // %s",
                (unsigned)obj->ei_osabi_, obj->osabiString());
       }
       if (obj->rpath_set_) {
-        printf(",\n\t\t\"rpath\": ");
-        json_quote(stdout, obj->rpath_);
+        out.put(",\n\t\t\"rpath\": ");
+        out.quote(obj->rpath_);
       }
       if (obj->runpath_set_) {
-        printf(",\n\t\t\"runpath\": ");
-        json_quote(stdout, obj->runpath_);
+        out.put(",\n\t\t\"runpath\": ");
+        out.quote(obj->runpath_);
       }
       if (opt_verbosity < 2) {
-        printf("\n\t}");
+        out.put("\n\t}");
         break;
       }
-      printf(",\n\t\t\"finds\": ["); {
+      out.put(",\n\t\t\"finds\": ["); {
         auto &set = obj->req_found_;
         const char *sep = "\n\t\t\t";
         for (auto &found : set) {
-          printf("%s", sep); sep = ",\n\t\t\t";
-          print_objname(found);
+          out.put(sep); sep = ",\n\t\t\t";
+          print_objname(out, found);
         }
       }
-      printf("\n\t\t],\n\t\t\"misses\": ["); {
+      out.put("\n\t\t],\n\t\t\"misses\": ["); {
         auto &set = obj->req_missing_;
         const char *sep = "\n\t\t\t";
         for (auto &miss : set) {
-          printf("%s", sep); sep = ",\n\t\t\t";
-          json_quote(stdout, miss);
+          out.put(sep); sep = ",\n\t\t\t";
+          out.quote(miss);
         }
       }
 
-      printf("\n\t\t]\n\t}");
+      out.put("\n\t\t]\n\t}");
     } while(0);
   }
-  printf("\n] }\n");
+  out.put("\n] }\n");
 }
 
 void DB::ShowFound_json() {
-  printf("{ \"found_objects\": {");
+  JsonOut out(stdout);
+  out.put("{ \"found_objects\": {");
   const char *mainsep = "\n\t";
   for (const Elf *obj : objects_) {
     if (obj->req_found_.empty())
       continue;
-    printf("%s", mainsep); mainsep = ",\n\t";
-    print_objname(obj);
-    printf(": [");
+    out.put(mainsep); mainsep = ",\n\t";
+    print_objname(out, obj);
+    out.put(": [");
 
     const char *sep = "\n\t\t";
     for (auto &s : obj->req_found_) {
-      printf("%s", sep); sep = ",\n\t\t";
-      json_quote(stdout, s->basename_);
+      out.put(sep); sep = ",\n\t\t";
+      out.quote(s->basename_);
     }
-    printf("\n\t]");
+    out.put("\n\t]");
   }
-  printf("\n} }\n");
+  out.put("\n} }\n");
 }
 
 void DB::ShowFilelist_json(const FilterList    &pkg_filters,
                            const StrFilterList &str_filters)
 {
-  printf("{ \"filelist\": [");
+  JsonOut out(stdout);
+  out.put("{ \"filelist\": [");
   const char *mainsep = "\n\t";
-  for (auto &pkg : packages_) {
+  std::vector<uint64_t> shown;
+  for (auto &pkg : SelectPackages(pkg_filters)) {
     if (!util::all(pkg_filters, *this, *pkg))
       continue;
     if (!opt_quiet) {
-      printf("%s", mainsep); mainsep = ",\n\t";
-      json_quote(stdout, pkg->name_);
-      printf(": [");
+      out.put(mainsep); mainsep = ",\n\t";
+      out.quote(pkg->name_);
+      out.put(": [");
     }
 
     const char *sep = "\n\t\t";
-    for (auto &file : pkg->filelist_) {
-      if (!util::all(str_filters, file))
+    filter::StringFilter::Select(str_filters, pkg->filelist_, shown);
+    for (size_t i = 0; i != pkg->filelist_.size(); ++i) {
+      if (!(shown[i/64] & (uint64_t(1) << (i%64))))
         continue;
+      const std::string &file = pkg->filelist_[i];
       if (!opt_quiet) {
-        printf("%s", sep); sep = ",\n\t\t";
-        json_quote(stdout, file);
+        out.put(sep); sep = ",\n\t\t";
+        out.quote(file);
       } else {
-        printf("%s", mainsep); mainsep = ",\n\t";
-        json_quote(stdout, file);
+        out.put(mainsep); mainsep = ",\n\t";
+        out.quote(file);
       }
     }
     if (!opt_quiet)
-      printf("\n\t]");
+      out.put("\n\t]");
   }
-  printf("\n] }\n");
+  out.put("\n] }\n");
 }
 
 void DB::ShowMissing_json() {
-  printf("{ \"missing_objects\": {");
+  JsonOut out(stdout);
+  out.put("{ \"missing_objects\": {");
   const char *mainsep = "\n\t";
   for (const Elf *obj : objects_) {
     if (obj->req_missing_.empty())
       continue;
-    printf("%s", mainsep); mainsep = ",\n\t";
-    print_objname(obj);
-    printf(": [");
+    out.put(mainsep); mainsep = ",\n\t";
+    print_objname(out, obj);
+    out.put(": [");
 
     const char *sep = "\n\t\t";
     for (auto &s : obj->req_missing_) {
-      printf("%s", sep); sep = ",\n\t\t";
-      json_quote(stdout, s);
+      out.put(sep); sep = ",\n\t\t";
+      out.quote(s);
     }
-    printf("\n\t]");
+    out.put("\n\t]");
   }
-  printf("\n} }\n");
+  out.put("\n} }\n");
 }
 
-static void json_obj(size_t id, FILE *out, const Elf *obj) {
-  fprintf(out, "\n\t\t{\n"
-               "\t\t\t\"id\": %lu", (unsigned long)id);
+void DB::ShowMissingSymbols_json(const FilterList    &pkg_filters,
+                                 const ObjFilterList &obj_filters)
+{
+  JsonOut out(stdout);
+  out.put("{ \"missing_symbols\": {");
+  const char *mainsep = "\n\t";
+  SymbolList missing;
+  for (const Elf *obj : SelectObjects(pkg_filters, obj_filters)) {
+    if (!util::all(obj_filters, *this, *obj))
+      continue;
+    if (pkg_filters.size() &&
+        (!obj->owner_ || !util::all(pkg_filters, *this, *obj->owner_)))
+      continue;
+    if (!MissingSymbols(obj, missing))
+      continue;
+    out.put(mainsep); mainsep = ",\n\t";
+    print_objname(out, obj);
+    out.put(": [");
 
-  fprintf(out, ",\n\t\t\t\"dirname\": ");
-  json_quote(out, obj->dirname_);
-  fprintf(out, ",\n\t\t\t\"basename\": ");
-  json_quote(out, obj->basename_);
-  fprintf(out, ",\n\t\t\t\"ei_class\": %u", (unsigned)obj->ei_class_);
-  fprintf(out, ",\n\t\t\t\"ei_data\":  %u", (unsigned)obj->ei_data_);
-  fprintf(out, ",\n\t\t\t\"ei_osabi\": %u", (unsigned)obj->ei_osabi_);
-  if (obj->rpath_set_) {
-    fprintf(out, ",\n\t\t\t\"rpath\": ");
-    json_quote(out, obj->rpath_);
-  }
-  if (obj->runpath_set_) {
-    fprintf(out, ",\n\t\t\t\"runpath\": ");
-    json_quote(out, obj->runpath_);
-  }
-  if (obj->needed_.size()) {
-    fprintf(out, ",\n\t\t\t\"needed\": [");
-    bool comma = false;
-    for (auto &need : obj->needed_) {
-      if (comma) fputc(',', out);
-      comma = true;
-      fprintf(out, "\n\t\t\t\t");
-      json_quote(out, need);
+    const char *sep = "\n\t\t";
+    for (auto id : missing) {
+      out.put(sep); sep = ",\n\t\t";
+      out.quote(symbols::Name(id));
     }
-    fprintf(out, "\n\t\t\t]");
+    out.put("\n\t]");
   }
-
-  fprintf(out, "\n\t\t}");
+  out.put("\n} }\n");
 }
 
 template<class OBJLIST>
-static void json_objlist(FILE *out, const OBJLIST &list) {
+static void json_objlist(JsonOut &out, const OBJLIST &list) {
   if (!list.size())
     return;
   // let's group them...
@@ -413,134 +529,939 @@ static void json_objlist(FILE *out, const OBJLIST &list) {
   auto iter = list.begin();
   for (; i != count; ++i, ++iter) {
     if ((i & 0xF) == 0)
-      fprintf(out, "\n\t\t\t\t");
-    fprintf(out, "%lu, ", (*iter)->json_.id);
+      out.put("\n\t\t\t\t");
+    out.printf("%lu, ", (*iter)->json_.id);
   }
   if ((i & 0xF) == 0)
-    fprintf(out, "%s\n\t\t\t\t", (i ? "" : ","));
-  fprintf(out, "%lu", (*iter)->json_.id);
+    out.put("\n\t\t\t\t");
+  out.printf("%lu", (*iter)->json_.id);
 }
 
 template<class STRLIST>
-static void json_strlist(FILE *out, const STRLIST &list) {
+static void json_strlist(JsonOut &out, const STRLIST &list) {
   bool comma = false;
   for (auto &i : list) {
-    if (comma) fputc(',', out);
+    if (comma) out.put(',');
     comma = true;
-    fprintf(out, "\n\t\t\t\t");
-    json_quote(out, i);
+    out.put("\n\t\t\t\t");
+    out.quote(i);
   }
 }
 
-static void json_pkg(FILE *out, const Package *pkg) {
-  fprintf(out, "\n\t\t{");
-  const char *sep = "\n";
-  if (pkg->name_.size()) {
-    fprintf(out, "%s\t\t\t\"name\": ", sep);
-    json_quote(out, pkg->name_);
-    sep = ",\n";
+template<class STRLIST>
+static void json_strlist(JsonOut &out, const char *name, const STRLIST &list)
+{
+  if (list.empty())
+    return;
+  out.printf(",\n\t\t\t\"%s\": [", name);
+  json_strlist(out, list);
+  out.put("\n\t\t\t]");
+}
+
+// symbol IDs are process-local, the names are stored
+static void json_symlist(JsonOut &out, const char *name,
+                         const SymbolList &list)
+{
+  if (list.empty())
+    return;
+  out.printf(",\n\t\t\t\"%s\": [", name);
+  bool comma = false;
+  for (auto id : list) {
+    if (comma) out.put(',');
+    comma = true;
+    out.put("\n\t\t\t\t");
+    out.quote(symbols::Name(id));
+  }
+  out.put("\n\t\t\t]");
+}
+
+static void json_obj(size_t id, JsonOut &out, const Elf *obj) {
+  out.printf("\n\t\t{\n"
+               "\t\t\t\"id\": %lu", (unsigned long)id);
+
+  out.put(",\n\t\t\t\"dirname\": ");
+  out.quote(obj->dirname_);
+  out.put(",\n\t\t\t\"basename\": ");
+  out.quote(obj->basename_);
+  out.printf(",\n\t\t\t\"ei_class\": %u", (unsigned)obj->ei_class_);
+  out.printf(",\n\t\t\t\"ei_data\":  %u", (unsigned)obj->ei_data_);
+  out.printf(",\n\t\t\t\"ei_osabi\": %u", (unsigned)obj->ei_osabi_);
+  if (obj->rpath_set_) {
+    out.put(",\n\t\t\t\"rpath\": ");
+    out.quote(obj->rpath_);
+  }
+  if (obj->runpath_set_) {
+    out.put(",\n\t\t\t\"runpath\": ");
+    out.quote(obj->runpath_);
   }
+  json_strlist(out, "needed", obj->needed_);
+  if (obj->content_hash_) {
+    // as a string, json numbers tend to end up as doubles
+    out.printf(",\n\t\t\t\"content_hash\": \"%016llx\"",
+               (unsigned long long)obj->content_hash_);
+  }
+  if (obj->req_found_.size()) {
+    out.put(",\n\t\t\t\"found\": [");
+    json_objlist(out, obj->req_found_);
+    out.put("\n\t\t\t]");
+  }
+  json_strlist(out, "missing", obj->req_missing_);
+  json_symlist(out, "imports", obj->sym_imports_);
+  json_symlist(out, "exports", obj->sym_exports_);
+
+  out.put("\n\t\t}");
+}
+
+static void json_pkg(JsonOut &out, const Package *pkg) {
+  out.put("\n\t\t{\n\t\t\t\"name\": ");
+  out.quote(pkg->name_);
   if (pkg->version_.size()) {
-    fprintf(out, "%s\t\t\t\"version\": ", sep);
-    json_quote(out, pkg->version_);
-    sep = ",\n";
+    out.put(",\n\t\t\t\"version\": ");
+    out.quote(pkg->version_);
   }
   if (pkg->objects_.size()) {
-    fprintf(out, "%s\t\t\t\"objects\": [", sep);
+    out.put(",\n\t\t\t\"objects\": [");
     json_objlist(out, pkg->objects_);
-    fprintf(out, "\n\t\t\t]");
-    sep = ",\n";
+    out.put("\n\t\t\t]");
+  }
+  json_strlist(out, "groups",     pkg->groups_);
+  json_strlist(out, "depends",    pkg->depends_);
+  json_strlist(out, "optdepends", pkg->optdepends_);
+  json_strlist(out, "provides",   pkg->provides_);
+  json_strlist(out, "conflicts",  pkg->conflicts_);
+  json_strlist(out, "replaces",   pkg->replaces_);
+  json_strlist(out, "filelist",   pkg->filelist_);
+  if (pkg->archive_name_.size()) {
+    out.put(",\n\t\t\t\"archive_name\": ");
+    out.quote(pkg->archive_name_);
+    out.printf(",\n\t\t\t\"archive_size\": %llu"
+               ",\n\t\t\t\"archive_mtime\": %lld",
+               (unsigned long long)pkg->archive_size_,
+               (long long)pkg->archive_mtime_);
   }
 
-  fprintf(out, "\n\t\t}");
+  out.put("\n\t\t}");
 }
 
-#if 0
-static void json_obj_found(FILE *out, const Elf *obj, const ObjectSet &found) {
-  fprintf(out, "\n\t\t{"
-               "\n\t\t\t\"obj\": %lu"
-               "\n\t\t\t\"found\": [",
-          (unsigned long)obj->json_.id);
-  json_objlist(out, found);
-  fprintf(out, "\n\t\t\t]"
-               "\n\t\t}");
+static void json_toplist(JsonOut &out, const char *name,
+                         const StringList &list)
+{
+  out.printf("\t\"%s\": [", name);
+  const char *sep = "\n\t\t";
+  for (auto &i : list) {
+    out.put(sep); sep = ",\n\t\t";
+    out.quote(i);
+  }
+  out.put(list.empty() ? "],\n" : "\n\t],\n");
 }
 
-static void json_obj_missing(FILE *out, const Elf *obj,
-                             const StringSet &missing)
+static void json_toplist(JsonOut &out, const char *name,
+                         const StringSet &set)
 {
-  fprintf(out, "\n\t\t{"
-               "\n\t\t\t\"obj\": %lu"
-               "\n\t\t\t\"missing\": [",
-          (unsigned long)obj->json_.id);
-  json_strlist(out, missing);
-  fprintf(out, "\n\t\t\t]"
-               "\n\t\t}");
+  json_toplist(out, name, StringList(set.begin(), set.end()));
 }
-#endif
 
 bool db_store_json(DB *db, const std::string& filename) {
-  FILE *out = fopen(filename.c_str(), "wb");
-  if (!out) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (!file) {
     log(Error, "failed to open file `%s' for reading\n", filename.c_str());
     return false;
   }
 
   log(Message, "writing json database file\n");
 
-  guard close_out([out]() { fclose(out); });
+  guard close_file([file]() { fclose(file); });
+  JsonOut out(file); // flushes before the guard closes the file
+
+  out.printf("{\n"
+             "\t\"db_version\": %u,\n"
+             "\t\"name\": ", (unsigned)DB::CURRENT);
+  out.quote(db->name_);
+  out.printf(",\n"
+             "\t\"strict\": %s,\n"
+             "\t\"ld_order\": %s,\n"
+             "\t\"file_lists\": %s,\n"
+             "\t\"symbols\": %s,\n",
+             (db->strict_linking_     ? "true" : "false"),
+             (db->ld_order_           ? "true" : "false"),
+             (db->contains_filelists_ ? "true" : "false"),
+             (db->contains_symbols_   ? "true" : "false"));
+  json_toplist(out, "library_path",  db->library_path_);
+  json_toplist(out, "ignore_files",  db->ignore_file_rules_);
+  json_toplist(out, "assume_found",  db->assume_found_rules_);
+  json_toplist(out, "base_packages", db->base_packages_);
+  out.put("\t\"package_library_paths\": {");
+  const char *sep = "\n\t\t";
+  for (auto &iter : db->package_library_path_) {
+    out.put(sep); sep = ",\n\t\t";
+    out.quote(iter.first);
+    out.put(": [");
+    const char *psep = "\n\t\t\t";
+    for (auto &path : iter.second) {
+      out.put(psep); psep = ",\n\t\t\t";
+      out.quote(path);
+    }
+    out.put("\n\t\t]");
+  }
+  out.put(db->package_library_path_.empty() ? "},\n" : "\n\t},\n");
 
-  // we put the objects first as they don't directly depend on anything
+  // we put the objects first as they don't directly depend on anything,
+  // numbered up front as they refer to each other in "found"
   size_t id = 0;
-  fprintf(out, "{\n"
-               "\t\"objects\": [");
+  for (auto &obj : db->objects_)
+    obj->json_.id = id++;
+  out.put("\t\"objects\": [");
   bool comma = false;
   for (auto &obj : db->objects_) {
-    if (comma) fputc(',', out);
+    if (comma) out.put(',');
     comma = true;
-    obj->json_.id = id;
-    json_obj(id, out, obj);
-    ++id;
+    json_obj(obj->json_.id, out, obj);
   }
-  fprintf(out, "\n\t],\n"
+  out.printf("\n\t],\n"
                "\t\"packages\": [");
 
   // packages have a list of objects
   // above we numbered them with IDs to reuse here now
   comma = false;
   for (auto &pkg : db->packages_) {
-    if (comma) fputc(',', out);
+    if (comma) out.put(',');
     comma = true;
     json_pkg(out, pkg);
   }
 
-  fprintf(out, "\n\t]");
+  out.put("\n\t]");
+  out.put("\n}\n");
+  return true;
+}
+
+// Reads what db_store_json writes. The parser walks the text once and
+// stores each value where it belongs as it gets to it, no document tree
+// is built. Object ids are resolved once everything has been read.
+class JsonIn {
+ public:
+  JsonIn(const char *data, size_t size)
+  : begin_(data), at_(data), end_(data + size) {}
+
+  bool fail(const char *what) {
+    log(Error, "json database: %s at byte %lu\n", what,
+        (unsigned long)(at_ - begin_));
+    return false;
+  }
+
+  bool at_end() {
+    ws();
+    return at_ == end_;
+  }
+
+  template<typename MEMBER>
+  bool object(MEMBER &&member) {
+    if (!expect('{'))
+      return false;
+    if (consume('}'))
+      return true;
+    std::string key;
+    do {
+      if (!string(key) || !expect(':') || !member(key))
+        return false;
+    } while (consume(','));
+    return expect('}');
+  }
+
+  template<typename ITEM>
+  bool array(ITEM &&item) {
+    if (!expect('['))
+      return false;
+    if (consume(']'))
+      return true;
+    do {
+      if (!item())
+        return false;
+    } while (consume(','));
+    return expect(']');
+  }
+
+  bool strings(StringList &list) {
+    return array([this,&list]() {
+      list.emplace_back();
+      return string(list.back());
+    });
+  }
+
+  bool strings(StringSet &set) {
+    std::string str;
+    return array([this,&set,&str]() {
+      if (!string(str))
+        return false;
+      set.insert(set.end(), str);
+      return true;
+    });
+  }
+
+  bool string(std::string &out);
+  bool number(uint64_t &out);
+  bool number(int64_t &out);
+  bool boolean(bool &out);
+  bool skip();
 
-#if 0
-  if (!db->required_found.empty()) {
-    fprintf(out, ",\n\t\"found\": [");
-    comma = false;
-    for (auto &found : db->required_found) {
-      if (comma) fputc(',', out);
-      comma = true;
-      json_obj_found(out, found.first, found.second);
+ private:
+  const char *begin_;
+  const char *at_;
+  const char *end_;
+
+  void ws() {
+    while (at_ != end_ &&
+           (*at_ == ' ' || *at_ == '\t' || *at_ == '\n' || *at_ == '\r'))
+      ++at_;
+  }
+  bool consume(char c) {
+    ws();
+    if (at_ == end_ || *at_ != c)
+      return false;
+    ++at_;
+    return true;
+  }
+  bool expect(char c) {
+    if (consume(c))
+      return true;
+    char msg[] = "expected `?'";
+    msg[10] = c;
+    return fail(msg);
+  }
+  bool word(const char *w) {
+    size_t len = strlen(w);
+    if (size_t(end_ - at_) < len || memcmp(at_, w, len) != 0)
+      return false;
+    at_ += len;
+    return true;
+  }
+  bool hex4(unsigned &out);
+};
+
+bool JsonIn::hex4(unsigned &out) {
+  if (end_ - at_ < 4)
+    return fail("truncated \\u escape");
+  out = 0;
+  for (int i = 0; i != 4; ++i) {
+    char c = *at_++;
+    out <<= 4;
+    if      (c >= '0' && c <= '9') out |= unsigned(c - '0');
+    else if (c >= 'a' && c <= 'f') out |= unsigned(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F') out |= unsigned(c - 'A' + 10);
+    else return fail("bad \\u escape");
+  }
+  return true;
+}
+
+bool JsonIn::string(std::string &out) {
+  if (!expect('"'))
+    return false;
+  // the common case: no escapes, copy the whole thing at once
+  const char *from = at_;
+  while (at_ != end_ && *at_ != '"' && *at_ != '\\')
+    ++at_;
+  out.assign(from, at_);
+  while (at_ != end_) {
+    char c = *at_++;
+    if (c == '"')
+      return true;
+    if (c != '\\') {
+      out.push_back(c);
+      continue;
+    }
+    if (at_ == end_)
+      break;
+    switch (c = *at_++) {
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'n': out.push_back('\n'); break;
+      case 'r': out.push_back('\r'); break;
+      case 't': out.push_back('\t'); break;
+      case 'u': {
+        unsigned cp;
+        if (!hex4(cp))
+          return false;
+        if (cp >= 0xD800 && cp < 0xDC00) {
+          unsigned low;
+          if (!word("\\u") || !hex4(low) || low < 0xDC00 || low >= 0xE000)
+            return fail("bad surrogate pair");
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        if (cp < 0x80) {
+          out.push_back(char(cp));
+        } else if (cp < 0x800) {
+          out.push_back(char(0xC0 | (cp >> 6)));
+          out.push_back(char(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+          out.push_back(char(0xE0 | (cp >> 12)));
+          out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+          out.push_back(char(0x80 | (cp & 0x3F)));
+        } else {
+          out.push_back(char(0xF0 | (cp >> 18)));
+          out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+          out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+          out.push_back(char(0x80 | (cp & 0x3F)));
+        }
+        break;
+      }
+      default: // \" \\ \/
+        out.push_back(c);
+        break;
     }
-    fprintf(out, "\n\t]");
   }
+  return fail("unterminated string");
+}
 
+bool JsonIn::number(uint64_t &out) {
+  ws();
+  if (at_ == end_ || *at_ < '0' || *at_ > '9')
+    return fail("expected a number");
+  out = 0;
+  while (at_ != end_ && *at_ >= '0' && *at_ <= '9')
+    out = out * 10 + uint64_t(*at_++ - '0');
+  return true;
+}
 
-  if (!db->required_missing.empty()) {
-    fprintf(out, ",\n\t\"missing\": [");
-    comma = false;
-    for (auto &mis : db->required_missing) {
-      if (comma) fputc(',', out);
-      comma = true;
-      json_obj_missing(out, mis.first, mis.second);
+bool JsonIn::number(int64_t &out) {
+  ws();
+  bool neg = (at_ != end_ && *at_ == '-');
+  if (neg)
+    ++at_;
+  uint64_t value;
+  if (!number(value))
+    return false;
+  out = neg ? -int64_t(value) : int64_t(value);
+  return true;
+}
+
+bool JsonIn::boolean(bool &out) {
+  ws();
+  if (word("true"))
+    out = true;
+  else if (word("false"))
+    out = false;
+  else
+    return fail("expected true or false");
+  return true;
+}
+
+bool JsonIn::skip() {
+  ws();
+  if (at_ == end_)
+    return fail("unexpected end of file");
+  switch (*at_) {
+    case '{': {
+      return object([this](const std::string&) { return skip(); });
+    }
+    case '[':
+      return array([this]() { return skip(); });
+    case '"': {
+      std::string str;
+      return string(str);
     }
-    fprintf(out, "\n\t]");
+    default:
+      if (word("true") || word("false") || word("null"))
+        return true;
+      while (at_ != end_ && (strchr("+-.eE", *at_) ||
+                             (*at_ >= '0' && *at_ <= '9')))
+        ++at_;
+      return true;
   }
-#endif
+}
+
+static bool json_read_symlist(JsonIn &in, SymbolList &list) {
+  std::string name;
+  bool ok = in.array([&]() {
+    if (!in.string(name))
+      return false;
+    list.push_back(symbols::Intern(name.c_str(), name.length()));
+    return true;
+  });
+  // the process-local IDs may be ordered differently
+  std::sort(list.begin(), list.end());
+  return ok;
+}
 
-  fprintf(out, "\n}\n");
+static bool json_read_object(JsonIn &in, DB *db, std::vector<Elf*> &byid,
+                             std::vector<std::pair<Elf*, std::vector<uint64_t>>>
+                               &found)
+{
+  rptr<Elf> obj(new Elf);
+  uint64_t id = byid.size();
+  std::vector<uint64_t> finds;
+  bool ok = in.object([&](const std::string &key) {
+    uint64_t value;
+    if (key == "id")
+      return in.number(id);
+    if (key == "dirname")
+      return in.string(obj->dirname_);
+    if (key == "basename")
+      return in.string(obj->basename_);
+    if (key == "ei_class" || key == "ei_data" || key == "ei_osabi") {
+      if (!in.number(value))
+        return false;
+      (key == "ei_class" ? obj->ei_class_ :
+       key == "ei_data"  ? obj->ei_data_  : obj->ei_osabi_) =
+        (unsigned char)value;
+      return true;
+    }
+    if (key == "rpath")
+      return (obj->rpath_set_ = true) && in.string(obj->rpath_);
+    if (key == "runpath")
+      return (obj->runpath_set_ = true) && in.string(obj->runpath_);
+    if (key == "needed")
+      return in.strings(obj->needed_);
+    if (key == "content_hash") {
+      std::string hex;
+      if (!in.string(hex))
+        return false;
+      obj->content_hash_ = strtoull(hex.c_str(), nullptr, 16);
+      return true;
+    }
+    if (key == "found") {
+      return in.array([&]() {
+        return in.number(value) && (finds.push_back(value), true);
+      });
+    }
+    if (key == "missing")
+      return in.strings(obj->req_missing_);
+    if (key == "imports")
+      return json_read_symlist(in, obj->sym_imports_);
+    if (key == "exports")
+      return json_read_symlist(in, obj->sym_exports_);
+    return in.skip();
+  });
+  if (!ok)
+    return false;
+  if (id > 0xFFFFFFFFu)
+    return in.fail("object id out of range");
+  if (id >= byid.size())
+    byid.resize(id+1, nullptr);
+  if (byid[id])
+    return in.fail("duplicate object id");
+  byid[id] = obj;
+  if (finds.size())
+    found.emplace_back(obj, move(finds));
+  db->objects_.push_back(obj);
   return true;
 }
+
+static bool json_read_package(JsonIn &in, DB *db,
+                              std::vector<std::pair<Package*,
+                                                    std::vector<uint64_t>>>
+                                &contents)
+{
+  Package *pkg = new Package;
+  db->packages_.push_back(pkg);
+  std::vector<uint64_t> objects;
+  bool ok = in.object([&](const std::string &key) {
+    if (key == "name")
+      return in.string(pkg->name_);
+    if (key == "version")
+      return in.string(pkg->version_);
+    if (key == "objects") {
+      return in.array([&]() {
+        uint64_t id;
+        return in.number(id) && (objects.push_back(id), true);
+      });
+    }
+    if (key == "groups")     return in.strings(pkg->groups_);
+    if (key == "depends")    return in.strings(pkg->depends_);
+    if (key == "optdepends") return in.strings(pkg->optdepends_);
+    if (key == "provides")   return in.strings(pkg->provides_);
+    if (key == "conflicts")  return in.strings(pkg->conflicts_);
+    if (key == "replaces")   return in.strings(pkg->replaces_);
+    if (key == "filelist")   return in.strings(pkg->filelist_);
+    if (key == "archive_name")
+      return in.string(pkg->archive_name_);
+    if (key == "archive_size")
+      return in.number(pkg->archive_size_);
+    if (key == "archive_mtime")
+      return in.number(pkg->archive_mtime_);
+    return in.skip();
+  });
+  if (objects.size())
+    contents.emplace_back(pkg, move(objects));
+  return ok;
+}
+
+bool db_read_json(DB *db, const std::string& filename) {
+  std::string data;
+  {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file) {
+      log(Error, "failed to open file `%s' for reading\n", filename.c_str());
+      return false;
+    }
+    guard close_file([file]() { fclose(file); });
+    char buf[64 * 1024];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), file)) != 0)
+      data.append(buf, got);
+    if (ferror(file)) {
+      log(Error, "failed to read `%s'\n", filename.c_str());
+      return false;
+    }
+  }
+
+  log(Message, "reading json database\n");
+
+  JsonIn in(data.data(), data.length());
+  std::vector<Elf*> byid;
+  std::vector<std::pair<Elf*,     std::vector<uint64_t>>> found;
+  std::vector<std::pair<Package*, std::vector<uint64_t>>> contents;
+  bool full = false; // written with the depends, groups etc.
+
+  bool ok = in.object([&](const std::string &key) {
+    if (key == "db_version") {
+      uint64_t version;
+      if (!in.number(version))
+        return false;
+      if (version > DB::CURRENT) {
+        log(Error, "cannot read depdb version %lu files, (known up to %u)\n",
+            (unsigned long)version, (unsigned)DB::CURRENT);
+        return false;
+      }
+      db->loaded_version_ = static_cast<uint16_t>(version);
+      full = true;
+      return true;
+    }
+    if (key == "name")
+      return in.string(db->name_);
+    if (key == "strict")
+      return in.boolean(db->strict_linking_);
+    if (key == "ld_order")
+      return in.boolean(db->ld_order_);
+    if (key == "file_lists")
+      return in.boolean(db->contains_filelists_);
+    if (key == "symbols")
+      return in.boolean(db->contains_symbols_);
+    if (key == "library_path")
+      return in.strings(db->library_path_);
+    if (key == "ignore_files")
+      return in.strings(db->ignore_file_rules_);
+    if (key == "assume_found")
+      return in.strings(db->assume_found_rules_);
+    if (key == "base_packages")
+      return in.strings(db->base_packages_);
+    if (key == "package_library_paths") {
+      return in.object([&](const std::string &pkg) {
+        return in.strings(db->package_library_path_[pkg]);
+      });
+    }
+    if (key == "objects") {
+      return in.array([&]() {
+        return json_read_object(in, db, byid, found);
+      });
+    }
+    if (key == "packages") {
+      return in.array([&]() {
+        return json_read_package(in, db, contents);
+      });
+    }
+    return in.skip();
+  });
+  if (!ok)
+    return false;
+  if (!in.at_end())
+    return in.fail("trailing garbage");
+
+  auto lookup = [&byid](uint64_t id) -> Elf* {
+    return id < byid.size() ? byid[id] : nullptr;
+  };
+  for (auto &entry : found) {
+    for (uint64_t id : entry.second) {
+      Elf *obj = lookup(id);
+      if (!obj) {
+        log(Error, "json database: unknown object id %lu\n",
+            (unsigned long)id);
+        return false;
+      }
+      entry.first->req_found_.insert(obj);
+    }
+  }
+  for (auto &entry : contents) {
+    for (uint64_t id : entry.second) {
+      Elf *obj = lookup(id);
+      if (!obj) {
+        log(Error, "json database: unknown object id %lu\n",
+            (unsigned long)id);
+        return false;
+      }
+      obj->owner_ = entry.first;
+      entry.first->objects_.push_back(obj);
+    }
+  }
+
+  db->contains_package_depends_ = full;
+  db->contains_groups_          = full;
+  return true;
+}
+
+// Streaming query output (--output): one record per package or object,
+// written out whenever the buffer fills up. ndjson records are single
+// lines of json, the binary layout is described in the manpage.
+class RecordOut {
+ public:
+  explicit RecordOut(bool binary);
+  ~RecordOut() { flush(); }
+
+  void begin(char kind, const char *type);
+  void end();
+
+  void string  (const char *name, const std::string &value);
+  void string  (const char *name, const Elf *obj);
+  void optional(const char *name, bool set, const std::string &value);
+  void byte    (const char *name, unsigned value);
+
+  void begin_list(const char *name);
+  void item      (const std::string &value);
+  void item      (const Elf *obj);
+  void end_list  ();
+
+  template<typename LIST>
+  void list(const char *name, const LIST &items) {
+    begin_list(name);
+    for (auto &i : items)
+      item(i);
+    end_list();
+  }
+
+ private:
+  static const size_t block_size = 64 * 1024;
+  static bool         started_; // the binary header goes out once
+
+  bool        binary_;
+  std::string buf_;
+  size_t      record_; // binary: where the record's length goes
+  size_t      list_;   // binary: where the list's item count goes
+  uint32_t    count_;
+  bool        first_;  // ndjson: no comma before the next item
+
+  void key(const char *name) {
+    buf_.append(",\"");
+    buf_.append(name);
+    buf_.append("\":");
+  }
+  void u32(uint32_t value) {
+    buf_.append(4, '\0');
+    put32(buf_.length()-4, value);
+  }
+  void put32(size_t at, uint32_t value) {
+    buf_[at]   = char(value);
+    buf_[at+1] = char(value >> 8);
+    buf_[at+2] = char(value >> 16);
+    buf_[at+3] = char(value >> 24);
+  }
+  void bytes(const std::string &str) {
+    u32(uint32_t(str.length()));
+    buf_.append(str);
+  }
+  void quote(const std::string &str) {
+    buf_.push_back('"');
+    json_escape(buf_, str);
+    buf_.push_back('"');
+  }
+  void flush() {
+    if (buf_.length())
+      fwrite(buf_.data(), 1, buf_.length(), stdout);
+    buf_.clear();
+  }
+};
+
+bool RecordOut::started_ = false;
+
+RecordOut::RecordOut(bool binary)
+: binary_(binary), record_(0), list_(0), count_(0), first_(true)
+{
+  buf_.reserve(block_size + 4096);
+  if (binary_ && !started_) {
+    buf_.append("PDQ\1", 4);
+    started_ = true;
+  }
+}
+
+void RecordOut::begin(char kind, const char *type) {
+  if (binary_) {
+    buf_.push_back(kind);
+    record_ = buf_.length();
+    u32(0);
+    return;
+  }
+  buf_.append("{\"type\":\"");
+  buf_.append(type);
+  buf_.push_back('"');
+}
+
+void RecordOut::end() {
+  if (binary_)
+    put32(record_, uint32_t(buf_.length() - record_ - 4));
+  else
+    buf_.append("}\n");
+  if (buf_.length() >= block_size)
+    flush();
+}
+
+void RecordOut::string(const char *name, const std::string &value) {
+  if (binary_)
+    return bytes(value);
+  key(name);
+  quote(value);
+}
+
+void RecordOut::string(const char *name, const Elf *obj) {
+  string(name, obj->dirname_ + "/" + obj->basename_);
+}
+
+void RecordOut::optional(const char *name, bool set,
+                         const std::string &value)
+{
+  if (binary_) {
+    buf_.push_back(set ? 1 : 0);
+    return bytes(set ? value : std::string());
+  }
+  if (set)
+    string(name, value);
+}
+
+void RecordOut::byte(const char *name, unsigned value) {
+  if (binary_)
+    return buf_.push_back(char(value));
+  key(name);
+  buf_.append(std::to_string(value));
+}
+
+void RecordOut::begin_list(const char *name) {
+  if (binary_) {
+    list_  = buf_.length();
+    count_ = 0;
+    return u32(0);
+  }
+  key(name);
+  buf_.push_back('[');
+  first_ = true;
+}
+
+void RecordOut::item(const std::string &value) {
+  if (binary_) {
+    ++count_;
+    return bytes(value);
+  }
+  if (!first_)
+    buf_.push_back(',');
+  first_ = false;
+  quote(value);
+}
+
+void RecordOut::item(const Elf *obj) {
+  item(obj->dirname_ + "/" + obj->basename_);
+}
+
+void RecordOut::end_list() {
+  if (binary_)
+    put32(list_, count_);
+  else
+    buf_.push_back(']');
+}
+
+void DB::ShowPackages_records(bool                 filter_broken,
+                              bool                 filter_notempty,
+                              const FilterList    &pkg_filters,
+                              const ObjFilterList &obj_filters)
+{
+  RecordOut out(opt_output == OutputFormat::Binary);
+  for (auto &pkg : SelectPackages(pkg_filters)) {
+    if (!util::all(pkg_filters, *this, *pkg))
+      continue;
+    if (filter_broken && !IsBroken(pkg))
+      continue;
+    if (filter_notempty && IsEmpty(pkg, obj_filters))
+      continue;
+    out.begin('P', "package");
+    out.string("name",    pkg->name_);
+    out.string("version", pkg->version_);
+    out.list("groups",     pkg->groups_);
+    out.list("depends",    pkg->depends_);
+    out.list("optdepends", pkg->optdepends_);
+    out.list("provides",   pkg->provides_);
+    out.list("replaces",   pkg->replaces_);
+    out.list("conflicts",  pkg->conflicts_);
+    out.begin_list(filter_broken ? "broken" : "objects");
+    for (auto &obj : pkg->objects_) {
+      if (!util::all(obj_filters, *this, *obj))
+        continue;
+      if (filter_broken && !IsBroken(obj))
+        continue;
+      out.item(obj);
+    }
+    out.end_list();
+    out.end();
+  }
+}
+
+void DB::ShowObjects_records(const FilterList    &pkg_filters,
+                             const ObjFilterList &obj_filters)
+{
+  RecordOut out(opt_output == OutputFormat::Binary);
+  for (auto &obj : SelectObjects(pkg_filters, obj_filters)) {
+    if (!util::all(obj_filters, *this, *obj))
+      continue;
+    if (pkg_filters.size() &&
+        (!obj->owner_ || !util::all(pkg_filters, *this, *obj->owner_)))
+      continue;
+    out.begin('L', "object");
+    out.string("file",  obj);
+    out.byte  ("class", obj->ei_class_);
+    out.byte  ("data",  obj->ei_data_);
+    out.byte  ("osabi", obj->ei_osabi_);
+    out.optional("rpath",   obj->rpath_set_,   obj->rpath_);
+    out.optional("runpath", obj->runpath_set_, obj->runpath_);
+    out.list("finds",  obj->req_found_);
+    out.list("misses", obj->req_missing_);
+    out.end();
+  }
+}
+
+void DB::ShowMissing_records() {
+  RecordOut out(opt_output == OutputFormat::Binary);
+  for (const Elf *obj : objects_) {
+    if (obj->req_missing_.empty())
+      continue;
+    out.begin('M', "missing");
+    out.string("file", obj);
+    out.list("misses", obj->req_missing_);
+    out.end();
+  }
+}
+
+void DB::ShowFound_records() {
+  RecordOut out(opt_output == OutputFormat::Binary);
+  for (const Elf *obj : objects_) {
+    if (obj->req_found_.empty())
+      continue;
+    out.begin('F', "found");
+    out.string("file", obj);
+    out.list("finds", obj->req_found_);
+    out.end();
+  }
+}
+
+void DB::ShowFilelist_records(const FilterList    &pkg_filters,
+                              const StrFilterList &str_filters)
+{
+  RecordOut out(opt_output == OutputFormat::Binary);
+  std::vector<uint64_t> shown;
+  for (auto &pkg : SelectPackages(pkg_filters)) {
+    if (!util::all(pkg_filters, *this, *pkg))
+      continue;
+    out.begin('f', "files");
+    out.string("package", pkg->name_);
+    out.begin_list("files");
+    filter::StringFilter::Select(str_filters, pkg->filelist_, shown);
+    for (size_t i = 0; i != pkg->filelist_.size(); ++i) {
+      if (shown[i/64] & (uint64_t(1) << (i%64)))
+        out.item(pkg->filelist_[i]);
+    }
+    out.end_list();
+    out.end();
+  }
+}
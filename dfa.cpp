@@ -0,0 +1,534 @@
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+
+#include "dfa.h"
+
+namespace dfa {
+
+// Patterns needing more than this fall back to regcomp, and the DFA is
+// only built if it stays below max_states, the NFA is simulated otherwise.
+static const size_t max_nodes  = 8192;
+static const size_t max_states = 1024;
+
+using ByteSet = std::bitset<256>;
+
+static const struct {
+  const char *name;
+  int (*test)(int);
+} named_classes[] = {
+  { "alpha",  isalpha  }, { "digit",  isdigit  }, { "alnum",  isalnum  },
+  { "upper",  isupper  }, { "lower",  islower  }, { "space",  isspace  },
+  { "blank",  isblank  }, { "punct",  ispunct  }, { "print",  isprint  },
+  { "graph",  isgraph  }, { "cntrl",  iscntrl  }, { "xdigit", isxdigit },
+};
+
+struct Regex::Builder {
+  struct Ast {
+    enum Kind { Set, Begin, End, Cat, Alt, Repeat };
+    Kind             kind;
+    uint32_t         set;
+    int              min, max; // max < 0 means unbounded
+    std::vector<int> sub;
+  };
+
+  Regex             &re_;
+  const std::string &pattern_;
+  bool               icase_;
+  size_t             at_;
+  std::vector<Ast>   ast_;
+
+  Builder(Regex &re, const std::string &pattern, bool icase)
+  : re_(re), pattern_(pattern), icase_(icase), at_(0) {}
+
+  bool eof() const { return at_ >= pattern_.length(); }
+  unsigned char peek() const { return pattern_[at_]; }
+
+  int NewAst(Ast::Kind kind) {
+    ast_.push_back(Ast { kind, 0, 0, 0, {} });
+    return int(ast_.size()-1);
+  }
+
+  int SetAst(ByteSet set, bool negate) {
+    if (icase_) {
+      for (unsigned c = 0; c != 256; ++c) {
+        if (set[c]) {
+          set[tolower(c)] = true;
+          set[toupper(c)] = true;
+        }
+      }
+    }
+    if (negate)
+      set.flip();
+    set[0] = false; // regexec() never gets to see a NUL either
+    uint32_t id = uint32_t(re_.sets_.size() / 256);
+    for (unsigned c = 0; c != 256; ++c)
+      re_.sets_.push_back(set[c]);
+    int ast = NewAst(Ast::Set);
+    ast_[ast].set = id;
+    return ast;
+  }
+
+  // parser: all of these return -1 on errors and unsupported syntax
+  bool Parse(int &root) {
+    root = Alt();
+    return root >= 0 && eof(); // a stray ')' stops before the end
+  }
+
+  int Alt() {
+    int first = Cat();
+    if (first < 0 || eof() || peek() != '|')
+      return first;
+    int alt = NewAst(Ast::Alt);
+    ast_[alt].sub.push_back(first);
+    while (!eof() && peek() == '|') {
+      ++at_;
+      int next = Cat();
+      if (next < 0)
+        return -1;
+      ast_[alt].sub.push_back(next);
+    }
+    return alt;
+  }
+
+  int Cat() {
+    int cat = NewAst(Ast::Cat);
+    while (!eof() && peek() != '|' && peek() != ')') {
+      int item = Repeat();
+      if (item < 0)
+        return -1;
+      ast_[cat].sub.push_back(item);
+    }
+    return cat;
+  }
+
+  bool Number(int &n) {
+    if (eof() || !isdigit(peek()))
+      return false;
+    n = 0;
+    while (!eof() && isdigit(peek())) {
+      n = n*10 + (pattern_[at_++] - '0');
+      if (n > 255)
+        return false;
+    }
+    return true;
+  }
+
+  bool Interval(int &min, int &max) {
+    ++at_;
+    if (!Number(min))
+      return false;
+    max = min;
+    if (!eof() && peek() == ',') {
+      ++at_;
+      if (!eof() && peek() == '}')
+        max = -1;
+      else if (!Number(max) || max < min)
+        return false;
+    }
+    if (eof() || peek() != '}')
+      return false;
+    ++at_;
+    return true;
+  }
+
+  bool HasAnchor(int ast) const {
+    const Ast &a = ast_[ast];
+    if (a.kind == Ast::Begin || a.kind == Ast::End)
+      return true;
+    for (int sub : a.sub) {
+      if (HasAnchor(sub))
+        return true;
+    }
+    return false;
+  }
+
+  int Repeat() {
+    int atom = Atom();
+    while (atom >= 0 && !eof()) {
+      int min, max;
+      switch (peek()) {
+        case '*': min = 0; max = -1; ++at_; break;
+        case '+': min = 1; max = -1; ++at_; break;
+        case '?': min = 0; max =  1; ++at_; break;
+        case '{':
+          if (!Interval(min, max))
+            return -1;
+          break;
+        default:
+          return atom;
+      }
+      // glibc gets creative with repeated anchors, leave those to it
+      if (HasAnchor(atom))
+        return -1;
+      int rep = NewAst(Ast::Repeat);
+      ast_[rep].min = min;
+      ast_[rep].max = max;
+      ast_[rep].sub.push_back(atom);
+      atom = rep;
+    }
+    return atom;
+  }
+
+  int Atom() {
+    unsigned char c = pattern_[at_++];
+    ByteSet set;
+    switch (c) {
+      case '(': {
+        int sub = Alt();
+        if (sub < 0 || eof() || peek() != ')')
+          return -1;
+        ++at_;
+        return sub;
+      }
+      case '^': return NewAst(Ast::Begin);
+      case '$': return NewAst(Ast::End);
+      case '.': return SetAst(set, true);
+      case '[': return Bracket();
+      case '*': case '+': case '?': case '{':
+        return -1;
+      case '\\':
+        if (eof())
+          return -1;
+        c = pattern_[at_++];
+        if (c == 'w' || c == 'W') {
+          for (unsigned b = 0; b != 256; ++b)
+            set[b] = isalnum(b) || b == '_';
+          return SetAst(set, c == 'W');
+        }
+        if (c == 's' || c == 'S') {
+          for (unsigned b = 0; b != 256; ++b)
+            set[b] = isspace(b);
+          return SetAst(set, c == 'S');
+        }
+        // backreferences, word boundaries and the like
+        if (isalnum(c) || c == '<' || c == '>' || c == '`' || c == '\'')
+          return -1;
+        break;
+      default:
+        break;
+    }
+    set[c] = true;
+    return SetAst(set, false);
+  }
+
+  bool NamedClass(ByteSet &set) {
+    size_t end = pattern_.find(":]", at_+1);
+    if (end == std::string::npos)
+      return false;
+    std::string name(pattern_, at_+1, end-at_-1);
+    at_ = end+2;
+    for (const auto &cls : named_classes) {
+      if (name == cls.name) {
+        for (unsigned b = 0; b != 256; ++b) {
+          if (cls.test(b))
+            set[b] = true;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int Bracket() {
+    ByteSet set;
+    bool negate = !eof() && peek() == '^';
+    if (negate)
+      ++at_;
+    for (bool first = true; ; first = false) {
+      if (eof())
+        return -1;
+      unsigned char c = pattern_[at_++];
+      if (c == ']' && !first)
+        break;
+      if (c == '[' && !eof()) {
+        if (peek() == '.' || peek() == '=')
+          return -1;
+        if (peek() == ':') {
+          if (!NamedClass(set))
+            return -1;
+          // a class cannot start a range
+          if (at_+1 < pattern_.length() && peek() == '-' &&
+              pattern_[at_+1] != ']')
+            return -1;
+          continue;
+        }
+      }
+      unsigned char to = c;
+      if (at_+1 < pattern_.length() && peek() == '-' &&
+          pattern_[at_+1] != ']')
+      {
+        to = pattern_[at_+1];
+        at_ += 2;
+        if (to == '[' || to < c)
+          return -1;
+      }
+      for (unsigned b = c; b <= to; ++b)
+        set[b] = true;
+    }
+    return SetAst(set, negate);
+  }
+
+  // Thompson construction, back to front: emits the nodes for an ast
+  // continuing at next and stores the node to enter it through in entry.
+  int Add(Node::Type type, uint32_t set, int out, int out1 = -1) {
+    re_.nodes_.push_back(Node { type, set, out, out1 });
+    return int(re_.nodes_.size()-1);
+  }
+
+  bool Emit(int ast, int next, int &entry) {
+    if (re_.nodes_.size() > max_nodes)
+      return false;
+    const Ast &a = ast_[ast];
+    switch (a.kind) {
+      case Ast::Set:   entry = Add(Node::Byte,  a.set, next); return true;
+      case Ast::Begin: entry = Add(Node::Begin, 0,     next); return true;
+      case Ast::End:   entry = Add(Node::End,   0,     next); return true;
+      case Ast::Cat:
+        entry = next;
+        for (size_t i = a.sub.size(); i--; ) {
+          if (!Emit(a.sub[i], entry, entry))
+            return false;
+        }
+        return true;
+      case Ast::Alt:
+        if (!Emit(a.sub.back(), next, entry))
+          return false;
+        for (size_t i = a.sub.size()-1; i--; ) {
+          int alt;
+          if (!Emit(a.sub[i], next, alt))
+            return false;
+          entry = Add(Node::Split, 0, alt, entry);
+        }
+        return true;
+      case Ast::Repeat:
+        entry = next;
+        if (a.max < 0) {
+          int loop = Add(Node::Split, 0, -1, next);
+          int body;
+          if (!Emit(a.sub[0], loop, body))
+            return false;
+          re_.nodes_[loop].out = body;
+          entry = loop;
+        } else {
+          for (int i = a.min; i != a.max; ++i) {
+            int body;
+            if (!Emit(a.sub[0], entry, body))
+              return false;
+            entry = Add(Node::Split, 0, body, next);
+          }
+        }
+        for (int i = 0; i != a.min; ++i) {
+          if (!Emit(a.sub[0], entry, entry))
+            return false;
+        }
+        return true;
+    }
+    return false;
+  }
+
+  bool Literal(int ast, char &c) const {
+    if (ast_[ast].kind != Ast::Set)
+      return false;
+    const uint8_t *set = &re_.sets_[ast_[ast].set * 256];
+    int found = -1;
+    for (unsigned b = 0; b != 256; ++b) {
+      if (!set[b])
+        continue;
+      if (found >= 0)
+        return false;
+      found = int(b);
+    }
+    c = char(found);
+    return found >= 0;
+  }
+
+  // The longest run of single bytes at the top level has to appear in
+  // every matching string, which memmem() can check a lot faster.
+  void Required(int root) {
+    std::vector<int> items;
+    if (ast_[root].kind == Ast::Cat)
+      items = ast_[root].sub;
+    else
+      items.push_back(root);
+    std::string run;
+    bool all = !items.empty();
+    for (int item : items) {
+      char c;
+      if (!Literal(item, c)) {
+        run.clear();
+        all = false;
+        continue;
+      }
+      run.push_back(c);
+      if (run.length() > re_.required_.length())
+        re_.required_ = run;
+    }
+    re_.literal_ = all;
+  }
+};
+
+Regex::Regex()
+: start_      (-1),
+  literal_    (false),
+  have_dfa_   (false),
+  class_count_(0)
+{}
+
+bool Regex::Compile(const std::string &pattern, bool icase) {
+  nodes_.clear();
+  sets_.clear();
+  required_.clear();
+  states_.clear();
+  next_.clear();
+  literal_  = false;
+  have_dfa_ = false;
+
+  Builder builder(*this, pattern, icase);
+  int root;
+  if (!builder.Parse(root))
+    return false;
+  int match = builder.Add(Node::Match, 0, -1);
+  if (!builder.Emit(root, match, start_))
+    return false;
+  builder.Required(root);
+  have_dfa_ = BuildDFA();
+  return true;
+}
+
+void Regex::Closure(NodeList &set, bool at_start, bool at_end) const {
+  std::vector<bool> seen(nodes_.size());
+  NodeList stack;
+  stack.swap(set);
+  while (!stack.empty()) {
+    int id = stack.back();
+    stack.pop_back();
+    if (seen[id])
+      continue;
+    seen[id] = true;
+    const Node &node = nodes_[id];
+    switch (node.type) {
+      case Node::Split:
+        stack.push_back(node.out1);
+        stack.push_back(node.out);
+        continue; // nothing left to do with a split once it was followed
+      case Node::Begin:
+        if (at_start)
+          stack.push_back(node.out);
+        break;
+      case Node::End:
+        if (at_end)
+          stack.push_back(node.out);
+        break;
+      default:
+        break;
+    }
+    set.push_back(id);
+  }
+  std::sort(set.begin(), set.end());
+}
+
+void Regex::Step(const NodeList &from, unsigned char c, NodeList &to) const {
+  to.clear();
+  for (int id : from) {
+    const Node &node = nodes_[id];
+    if (node.type == Node::Byte && sets_[node.set*256 + c])
+      to.push_back(node.out);
+  }
+  // the search is unanchored, a match may start at every byte
+  to.push_back(start_);
+  Closure(to, false, false);
+}
+
+bool Regex::Accepts(const NodeList &set, bool at_start, bool at_end) const {
+  NodeList all(set);
+  Closure(all, at_start, at_end);
+  for (int id : all) {
+    if (nodes_[id].type == Node::Match)
+      return true;
+  }
+  return false;
+}
+
+bool Regex::BuildDFA() {
+  // bytes no set can tell apart share a column in the transition table
+  std::map<std::vector<bool>, uint8_t> columns;
+  unsigned char representative[256];
+  const size_t set_count = sets_.size() / 256;
+  class_count_ = 0;
+  for (unsigned c = 0; c != 256; ++c) {
+    std::vector<bool> signature(set_count);
+    for (size_t s = 0; s != set_count; ++s)
+      signature[s] = sets_[s*256 + c];
+    auto col = columns.find(signature);
+    if (col == columns.end()) {
+      col = columns.emplace(move(signature), uint8_t(class_count_)).first;
+      representative[class_count_++] = c;
+    }
+    classes_[c] = col->second;
+  }
+
+  // state 0 is the only one at the start of the string, so it never gets
+  // merged with a later one
+  std::vector<NodeList> sets(1, NodeList { start_ });
+  std::map<NodeList, uint32_t> ids;
+  Closure(sets[0], true, false);
+
+  NodeList to;
+  for (size_t i = 0; i != sets.size(); ++i) {
+    states_.push_back(State { Accepts(sets[i], i == 0, false),
+                              Accepts(sets[i], i == 0, true) });
+    for (unsigned k = 0; k != class_count_; ++k) {
+      Step(sets[i], representative[k], to);
+      auto id = ids.find(to);
+      if (id == ids.end()) {
+        if (sets.size() >= max_states) {
+          states_.clear();
+          next_.clear();
+          return false;
+        }
+        id = ids.emplace(to, uint32_t(sets.size())).first;
+        sets.push_back(to);
+      }
+      next_.push_back(id->second);
+    }
+  }
+  return true;
+}
+
+bool Regex::Simulate(const char *str, size_t length) const {
+  NodeList set { start_ }, next;
+  Closure(set, true, false);
+  for (size_t i = 0; i != length; ++i) {
+    if (Accepts(set, false, false))
+      return true;
+    Step(set, (unsigned char)str[i], next);
+    set.swap(next);
+  }
+  return Accepts(set, length == 0, true);
+}
+
+bool Regex::Search(const char *str, size_t length) const {
+  if (!required_.empty() &&
+      !memmem(str, length, required_.data(), required_.length()))
+  {
+    return false;
+  }
+  if (literal_)
+    return true;
+  if (!have_dfa_)
+    return Simulate(str, length);
+
+  uint32_t state = 0;
+  for (size_t i = 0; i != length; ++i) {
+    if (states_[state].accept)
+      return true;
+    state = next_[state*class_count_ + classes_[(unsigned char)str[i]]];
+  }
+  return states_[state].accept_end;
+}
+
+} // namespace dfa
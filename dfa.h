@@ -0,0 +1,69 @@
+#ifndef PKGDEPDB_DFA_H__
+#define PKGDEPDB_DFA_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace dfa {
+
+// POSIX extended regular expressions compiled to a DFA over bytes, for
+// filters which only need to know whether a string contains a match.
+// Matching is linear in the length of the string. Backreferences, word
+// boundaries and collating elements are not supported, Compile() fails
+// for them (and for syntax errors) so the caller can fall back to regcomp.
+class Regex {
+ public:
+  Regex();
+
+  bool Compile(const std::string &pattern, bool icase);
+  bool Search (const char *str, size_t length) const;
+  bool Search (const std::string &str) const {
+    return Search(str.data(), str.length());
+  }
+
+ private:
+  struct Node {
+    enum Type : uint8_t {
+      Byte,  // consumes one byte of a set, goes to out
+      Split, // goes to out and out1
+      Begin, // goes to out at the start of the string
+      End,   // goes to out at the end of the string
+      Match
+    };
+    Type     type;
+    uint32_t set;
+    int      out;
+    int      out1;
+  };
+  struct State {
+    bool accept;     // a match ended here
+    bool accept_end; // a match ends here if the string does
+  };
+  using NodeList = std::vector<int>;
+  struct Builder; // the parser, see dfa.cpp
+
+  std::vector<Node>     nodes_;
+  std::vector<uint8_t>  sets_;     // 256 bytes per byte set
+  int                   start_;
+  std::string           required_; // a literal every match contains
+  bool                  literal_;  // required_ is the whole pattern
+
+  // the DFA, unless it got too big, in which case the NFA is simulated
+  bool                  have_dfa_;
+  uint8_t               classes_[256];
+  unsigned              class_count_;
+  std::vector<State>    states_;
+  std::vector<uint32_t> next_; // states_ * class_count_
+
+  void Closure(NodeList &set, bool at_start, bool at_end) const;
+  void Step(const NodeList &from, unsigned char c, NodeList &to) const;
+  bool Accepts(const NodeList &set, bool at_start, bool at_end) const;
+  bool BuildDFA();
+  bool Simulate(const char *str, size_t length) const;
+};
+
+} // namespace dfa
+
+#endif
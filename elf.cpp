@@ -1,17 +1,71 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <elf.h>
 
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef ENABLE_THREADS
+#  include <mutex>
+#endif
+
 #include "main.h"
 #include "endian.h"
 
+namespace symbols {
+
+// The map's nodes are stable, so the ID->name table can point into it.
+static std::unordered_map<std::string, SymbolID> ids;
+static std::vector<const std::string*>           names;
+#ifdef ENABLE_THREADS
+static std::mutex                                mutex;
+#endif
+
+SymbolID Intern(const char *name, size_t length) {
+  std::string key(name, length);
+#ifdef ENABLE_THREADS
+  std::lock_guard<std::mutex> lock(mutex);
+#endif
+  auto iter = ids.find(key);
+  if (iter != ids.end())
+    return iter->second;
+  auto id = static_cast<SymbolID>(names.size());
+  iter = ids.emplace(std::move(key), id).first;
+  names.push_back(&iter->first);
+  return id;
+}
+
+const std::string& Name(SymbolID id) {
+  return *names[id];
+}
+
+size_t Count() {
+  return names.size();
+}
+
+void Lock() {
+#ifdef ENABLE_THREADS
+  mutex.lock();
+#endif
+}
+
+void Unlock() {
+#ifdef ENABLE_THREADS
+  mutex.unlock();
+#endif
+}
+
+} // namespace symbols
+
 Elf::Elf()
 : refcount_   (0),
   ei_class_   (0),
   ei_osabi_   (0),
   rpath_set_  (false),
   runpath_set_(false),
+  content_hash_(0),
   owner_      (nullptr)
 {}
 
@@ -27,12 +81,15 @@ Elf::Elf(const Elf& cp)
   rpath_      (cp.rpath_),
   runpath_    (cp.runpath_),
   needed_     (cp.needed_),
+  sym_imports_(cp.sym_imports_),
+  sym_exports_(cp.sym_exports_),
+  content_hash_(cp.content_hash_),
   req_found_  (cp.req_found_),
   req_missing_(cp.req_missing_),
   owner_      (cp.owner_)
 {}
 
-template<bool BE, typename HDR, typename SecHDR, typename Dyn>
+template<bool BE, typename HDR, typename SecHDR, typename Dyn, typename Sym>
 Elf* LoadElf(const char *data, size_t size, bool *waserror, const char *name) {
   std::unique_ptr<Elf> object(new Elf);
 
@@ -181,18 +238,93 @@ Elf* LoadElf(const char *data, size_t size, bool *waserror, const char *name) {
     }
   }
 
+  if (opt_package_symbols) {
+    SecHDR *symhdr = findsec([](SecHDR *hdr) {
+      return Eswap<BE>(hdr->sh_type) == SHT_DYNSYM;
+    });
+    if (symhdr) {
+      if (Eswap<BE>(symhdr->sh_entsize) != sizeof(Sym)) {
+        log(Error, "%s: invalid entsize for dynamic symbol table\n", name);
+        return 0;
+      }
+      auto link = Eswap<BE>(symhdr->sh_link);
+      if (link >= shnum) {
+        log(Error, "%s: invalid string table link in .dynsym\n", name);
+        return 0;
+      }
+      SecHDR *symstrsec = sec_start + link;
+      auto   symstr_at  = ssize_t(Eswap<BE>(symstrsec->sh_offset));
+      size_t symstr_sz  = Eswap<BE>(symstrsec->sh_size);
+      if (!checksize(symstr_at, symstr_sz, ".dynsym string table"))
+        return 0;
+
+      auto   sym_at   = ssize_t(Eswap<BE>(symhdr->sh_offset));
+      size_t symcount = Eswap<BE>(symhdr->sh_size) / sizeof(Sym);
+      if (!checksize(sym_at, symcount * sizeof(Sym), ".dynsym entries"))
+        return 0;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-align"
+      Sym *sym_start = (Sym*)(data + sym_at);
+#pragma clang diagnostic pop
+      const char *strtab = data + symstr_at;
+      // entry 0 is the reserved undefined symbol
+      for (size_t i = 1; i < symcount; ++i) {
+        Sym *sym = sym_start + i;
+        size_t off = Eswap<BE>(sym->st_name);
+        if (!off)
+          continue;
+        if (off >= symstr_sz) {
+          log(Error, "%s: out of bounds symbol name\n", name);
+          return 0;
+        }
+        // st_info and st_other are single bytes, no swapping needed
+        unsigned char type = sym->st_info & 0xf;
+        unsigned char bind = sym->st_info >> 4;
+        if (type == STT_SECTION || type == STT_FILE)
+          continue;
+        if (bind != STB_GLOBAL && bind != STB_WEAK && bind != STB_GNU_UNIQUE)
+          continue;
+
+        const char *str = strtab + off;
+        const void *nul = memchr(str, 0, symstr_sz - off);
+        if (!nul) {
+          log(Error, "%s: unterminated string in string table\n", name);
+          return 0;
+        }
+        size_t len = size_t((const char*)nul - str);
+
+        if (Eswap<BE>(sym->st_shndx) == SHN_UNDEF) {
+          // weak references are allowed to stay unresolved
+          if (bind != STB_WEAK)
+            object->sym_imports_.push_back(symbols::Intern(str, len));
+        } else {
+          unsigned char vis = sym->st_other & 0x3;
+          if (vis == STV_DEFAULT || vis == STV_PROTECTED)
+            object->sym_exports_.push_back(symbols::Intern(str, len));
+        }
+      }
+      auto sortlist = [](SymbolList &list) {
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+      };
+      sortlist(object->sym_imports_);
+      sortlist(object->sym_exports_);
+    }
+  }
+
   *waserror = false;
   return object.release();
 }
 
-static
-const auto LoadElf32LE = &LoadElf<false, Elf32_Ehdr, Elf32_Shdr, Elf32_Dyn>;
-static
-const auto LoadElf32BE = &LoadElf<true,  Elf32_Ehdr, Elf32_Shdr, Elf32_Dyn>;
-static
-const auto LoadElf64LE = &LoadElf<false, Elf64_Ehdr, Elf64_Shdr, Elf64_Dyn>;
-static
-const auto LoadElf64BE = &LoadElf<true,  Elf64_Ehdr, Elf64_Shdr, Elf64_Dyn>;
+static const auto LoadElf32LE =
+  &LoadElf<false, Elf32_Ehdr, Elf32_Shdr, Elf32_Dyn, Elf32_Sym>;
+static const auto LoadElf32BE =
+  &LoadElf<true,  Elf32_Ehdr, Elf32_Shdr, Elf32_Dyn, Elf32_Sym>;
+static const auto LoadElf64LE =
+  &LoadElf<false, Elf64_Ehdr, Elf64_Shdr, Elf64_Dyn, Elf64_Sym>;
+static const auto LoadElf64BE =
+  &LoadElf<true,  Elf64_Ehdr, Elf64_Shdr, Elf64_Dyn, Elf64_Sym>;
 
 Elf* Elf::Open(const char *data, size_t size, bool *waserror, const char *name)
 {
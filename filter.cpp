@@ -3,9 +3,15 @@
 # include <regex.h>
 #endif
 
+#include <string.h>
+
 #include <algorithm>
+#include <bitset>
 
 #include "main.h"
+#ifdef WITH_REGEX
+# include "dfa.h"
+#endif
 
 namespace util {
   template<typename C, typename K>
@@ -17,28 +23,106 @@ namespace util {
 
 namespace filter {
 
-Match::Match() {}
+Match::Match() : refcount_(0) {}
 Match::~Match() {}
 
+bool Match::IndexKey(std::string &key, bool &exact) const {
+  (void)key; (void)exact;
+  return false;
+}
+
+// fills the mask for Matches() from a non-virtual test
+template<typename PRED>
+static size_t
+match_batch(const std::string *strings, size_t count, uint64_t *mask,
+            PRED &&test)
+{
+  size_t found = 0;
+  for (size_t word = 0; word*64 < count; ++word) {
+    const size_t from = word*64;
+    const size_t to   = std::min(count, from+64);
+    uint64_t bits = 0;
+    for (size_t i = from; i != to; ++i) {
+      if (test(strings[i])) {
+        bits |= uint64_t(1) << (i-from);
+        ++found;
+      }
+    }
+    mask[word] = bits;
+  }
+  return found;
+}
+
+size_t Match::Matches(const std::string *strings, size_t count,
+                      uint64_t *mask) const
+{
+  return match_batch(strings, count, mask, [this](const std::string &str) {
+    return (*this)(str);
+  });
+}
+
+bool Match::Any(const StringList &list) const {
+  uint64_t mask;
+  for (size_t i = 0; i < list.size(); i += 64) {
+    if (Matches(&list[i], std::min(list.size()-i, size_t(64)), &mask))
+      return true;
+  }
+  return false;
+}
+
 class ExactMatch : public Match {
  public:
   std::string text_;
   ExactMatch(std::string&&);
   bool operator()(const std::string&) const override;
+  size_t Matches(const std::string*, size_t, uint64_t*) const override;
+  bool IndexKey(std::string &key, bool &exact) const override;
 };
 
+// Globs are compiled into a list of single-character steps and stars.
+// Matching walks them with a single backtracking point (the last star),
+// after checking the literal parts with plain string compares.
 class GlobMatch : public Match {
  public:
   std::string glob_;
   GlobMatch(std::string&&);
   bool operator()(const std::string&) const override;
+  size_t Matches(const std::string*, size_t, uint64_t*) const override;
+  bool IndexKey(std::string &key, bool &exact) const override;
+
+ private:
+  enum class Op : uint8_t {
+    Char,
+    Any,
+    Group,
+    Star,
+    StarAny // a run of stars containing a '?'
+  };
+  struct Step {
+    Op            op;
+    unsigned char ch;
+    uint32_t      group;
+  };
+  std::vector<Step>             steps_;
+  std::vector<std::bitset<256>> groups_;
+  std::string prefix_; // literal steps at the start
+  std::string suffix_; // literal steps after the last star
+  std::string infix_;  // longest literal run in between
+  bool        stars_;
+
+  void compile();
+  bool run(const std::string&, size_t t, size_t s) const;
 };
 
 ExactMatch::ExactMatch(std::string &&text)
 : text_(move(text)) {}
 
 GlobMatch::GlobMatch(std::string &&glob)
-: glob_(move(glob)) {}
+: glob_ (move(glob)),
+  stars_(false)
+{
+  compile();
+}
 
 rptr<Match> Match::CreateExact(std::string &&text) {
   return new ExactMatch(move(text));
@@ -53,18 +137,27 @@ class RegexMatch : public Match {
  public:
   std::string pattern_;
   bool        icase_;
+  dfa::Regex  dfa_;
   regex_t     regex_;
+  bool        posix_; // dfa_ could not handle the pattern
   bool        compiled_;
   RegexMatch(std::string&&, bool icase);
   ~RegexMatch();
   bool operator()(const std::string&) const override;
+  size_t Matches(const std::string*, size_t, uint64_t*) const override;
 };
 
 RegexMatch::RegexMatch(std::string &&pattern, bool icase)
 : pattern_ (move(pattern)),
   icase_   (icase),
+  posix_   (false),
   compiled_(false)
 {
+  if (dfa_.Compile(pattern_, icase)) {
+    compiled_ = true;
+    return;
+  }
+
   int cflags = REG_NOSUB | REG_EXTENDED;
   if (icase) cflags |= REG_ICASE;
 
@@ -78,11 +171,13 @@ RegexMatch::RegexMatch(std::string &&pattern, bool icase)
     log(Error, "regex error: %s\n", buf);
     return;
   }
+  posix_    = true;
   compiled_ = true;
 }
 
 RegexMatch::~RegexMatch() {
-  regfree(&regex_);
+  if (posix_)
+    regfree(&regex_);
 }
 
 rptr<Match> Match::CreateRegex(std::string &&text, bool icase) {
@@ -94,14 +189,14 @@ rptr<Match> Match::CreateRegex(std::string &&text, bool icase) {
 #endif
 
 PackageFilter::PackageFilter(bool negate)
-: negate_(negate)
+: negate_(negate), field_(Field::None)
 {}
 
 PackageFilter::~PackageFilter()
 {}
 
 ObjectFilter::ObjectFilter(bool negate)
-: refcount_(0), negate_(negate)
+: refcount_(0), negate_(negate), field_(Field::None)
 {}
 
 ObjectFilter::~ObjectFilter()
@@ -161,122 +256,181 @@ class StrFilt : public StringFilter {
 
 // Utility functions:
 
-static bool match_glob(const std::string &glob, size_t g,
-                       const std::string &str,  size_t s)
-// tail recursive
-{
-  size_t from, to;
-  bool neg = false;
-
-  auto parse_group = [&]() -> bool {
-    from = ++g;
-    neg = (g < glob.length() && glob[g] == '^');
-    if (neg) ++from;
-    if (glob[g] == ']') // if the group contains a ] it must come first
+void GlobMatch::compile() {
+  const std::string &glob = glob_;
+  size_t g = 0;
+  while (g < glob.length()) {
+    if (glob[g] == '*') {
+      Op op = Op::Star;
+      for (; g < glob.length() && (glob[g] == '*' || glob[g] == '?'); ++g) {
+        if (glob[g] == '?')
+          op = Op::StarAny;
+      }
+      steps_.push_back({op, 0, 0});
+      stars_ = true;
+      continue;
+    }
+    if (glob[g] == '?') {
+      steps_.push_back({Op::Any, 0, 0});
       ++g;
-    while (g < glob.length() && glob[g] != ']')
+      continue;
+    }
+    if (glob[g] != '[') {
+      steps_.push_back({Op::Char, (unsigned char)glob[g], 0});
       ++g;
-    if (g >= glob.length()) {
-      // glob syntax error, treat the [ as a regular [ character
-      g = from-1;
-      return false;
+      continue;
     }
-    to = g-1;
-    return true;
-  };
 
-  auto matches_group = [&](const char c) -> bool {
-    for (size_t f = from; f != to+1; ++f) {
-      if (f > from && f != to && glob[f] == '-') {
-        ++f;
-        if (c >= glob[f-1] && c <= glob[f])
-          return !neg;
-      }
-      if (c == glob[f]) {
-        return !neg;
+    size_t from = g+1;
+    size_t end  = from;
+    bool   neg  = (end < glob.length() && glob[end] == '^');
+    if (neg) ++from;
+    if (end < glob.length() && glob[end] == ']') // a ] must come first
+      ++end;
+    while (end < glob.length() && glob[end] != ']')
+      ++end;
+    if (end >= glob.length()) {
+      // glob syntax error, treat the [ as a regular [ character
+      steps_.push_back({Op::Char, (unsigned char)'[', 0});
+      ++g;
+      continue;
+    }
+    const size_t to = end-1;
+
+    std::bitset<256> group;
+    for (unsigned int i = 0; i != 256; ++i) {
+      const char c = (char)i;
+      bool found = false;
+      for (size_t f = from; f != to+1 && !found; ++f) {
+        if (f > from && f != to && glob[f] == '-') {
+          ++f;
+          if (c >= glob[f-1] && c <= glob[f])
+            found = true;
+        }
+        if (c == glob[f])
+          found = true;
       }
+      group[i] = (found != neg);
     }
-    return neg;
-  };
+    steps_.push_back({Op::Group, 0, (uint32_t)groups_.size()});
+    groups_.push_back(group);
+    g = end+1;
+  }
 
-  if (g >= glob.length()) // nothing else to match
-    return s >= str.length(); // true if there are no contents to match either
-  if (s >= str.length()) {
-    if (glob[g] == '*')
-      return match_glob(glob, g+1, str, s+1);
-    return false;
+  // literal runs for the quick checks
+  size_t t = 0;
+  for (; t != steps_.size() && steps_[t].op == Op::Char; ++t)
+    prefix_.push_back(steps_[t].ch);
+  if (!stars_)
+    return;
+  size_t tail = steps_.size();
+  while (tail && steps_[tail-1].op == Op::Char)
+    --tail;
+  if (steps_[tail-1].op == Op::Star || steps_[tail-1].op == Op::StarAny) {
+    for (size_t i = tail; i != steps_.size(); ++i)
+      suffix_.push_back(steps_[i].ch);
   }
-  switch (glob[g]) {
-    default:
-      if (glob[g] != str[s])
-        return false;
-      return match_glob(glob, g+1, str, s+1);
-    case '?':
-      return match_glob(glob, g+1, str, s+1);
-    case '[':
-      if (!parse_group()) {
-        if (str[s] != '[')
-          return false;
-        return match_glob(glob, g+1, str, s+1);
-      }
-      if (!matches_group(str[s]))
-        return false;
-      return match_glob(glob, g+1, str, s+1);
+  std::string run;
+  for (; t < tail; ++t) {
+    if (steps_[t].op == Op::Char) {
+      run.push_back(steps_[t].ch);
+      continue;
+    }
+    if (run.length() > infix_.length())
+      infix_ = run;
+    run.clear();
+  }
+  if (run.length() > infix_.length())
+    infix_ = run;
+}
 
-    case '*':
-    {
-      bool wasgroup = false;
-      while (g < glob.length() && (glob[g] == '*' || glob[g] == '?')) ++g;
-      if (g >= glob.length()) // ended with a set of * and ?, so we match
-        return true;
-      if (glob[g] == '[')
-        wasgroup = parse_group();
-      while (s < str.length()) {
-        if ( (wasgroup && matches_group(str[s])) ||
-             (!wasgroup && str[s] == glob[g]) )
-        {
-          // next character matches here, fork off:
-          if (match_glob(glob, g+1, str, s+1))
-            return true;
-        }
-        ++s; // otherwise gobble it up into the *
+bool GlobMatch::run(const std::string &str, size_t t, size_t s) const {
+  const size_t count = steps_.size();
+  size_t star   = std::string::npos;
+  size_t star_s = 0;
+  while (s < str.length()) {
+    if (t < count) {
+      const Step &step = steps_[t];
+      const unsigned char c = str[s];
+      if (step.op == Op::Star || step.op == Op::StarAny) {
+        star   = t++;
+        star_s = s;
+        continue;
+      }
+      if (step.op == Op::Any ||
+          (step.op == Op::Char  && step.ch == c) ||
+          (step.op == Op::Group && groups_[step.group][c]))
+      {
+        ++t;
+        ++s;
+        continue;
       }
-      return false;
     }
+    // no match here, let the last star eat another character
+    if (star == std::string::npos)
+      return false;
+    t = star+1;
+    s = ++star_s;
   }
+  // at the end of the string only plain stars may remain
+  while (t < count && steps_[t].op == Op::Star)
+    ++t;
+  return t == count;
+}
+
+// remember the field and matcher for the query planner
+template<typename FILTER, typename FIELD>
+static unique_ptr<FILTER>
+indexed(unique_ptr<FILTER> &&filt, FIELD field, rptr<Match> matcher) {
+  filt->field_ = field;
+  filt->match_ = matcher;
+  return move(filt);
 }
 
 unique_ptr<PackageFilter> PackageFilter::name(rptr<Match> matcher, bool neg) {
-  return mk_unique<PkgFilt>(neg, [matcher](const Package &pkg) {
+  return indexed(mk_unique<PkgFilt>(neg, [matcher](const Package &pkg) {
     return (*matcher)(pkg.name_);
-  });
+  }), Field::Name, matcher);
+}
+
+// string lists go through the batch matcher, sets one string at a time
+static inline bool
+match_any(const Match &matcher, const StringList &list) {
+  return matcher.Any(list);
+}
+
+static inline bool
+match_any(const Match &matcher, const StringSet &set) {
+  for (auto &i : set) {
+    if (matcher(i))
+      return true;
+  }
+  return false;
 }
 
 template<typename CONT>
 static unique_ptr<PackageFilter>
-make_pkgfilter(rptr<Match> matcher, bool neg, CONT (Package::*member)) {
-  return mk_unique<PkgFilt>(neg, [matcher,member](const Package &pkg) {
-    for (auto &i : pkg.*member) {
-      if ((*matcher)(i))
-        return true;
-    }
-    return false;
-  });
+make_pkgfilter(rptr<Match> matcher, bool neg, CONT (Package::*member),
+               PackageFilter::Field field)
+{
+  return indexed(mk_unique<PkgFilt>(neg, [matcher,member](const Package &pkg) {
+    return match_any(*matcher, pkg.*member);
+  }), field, matcher);
 }
-#define MAKE_PKGFILTER(NAME,VAR)                      \
+#define MAKE_PKGFILTER(NAME,VAR,FIELD)                \
 unique_ptr<PackageFilter>                             \
 PackageFilter::NAME(rptr<Match> matcher, bool neg) {  \
-  return make_pkgfilter(matcher, neg, &Package::VAR##_); \
+  return make_pkgfilter(matcher, neg, &Package::VAR##_, Field::FIELD); \
 }
 
-#define MAKE_PKGFILTER1(NAME) MAKE_PKGFILTER(NAME,NAME)
+#define MAKE_PKGFILTER1(NAME,FIELD) MAKE_PKGFILTER(NAME,NAME,FIELD)
 
-MAKE_PKGFILTER(group,groups)
-MAKE_PKGFILTER1(depends)
-MAKE_PKGFILTER1(optdepends)
-MAKE_PKGFILTER1(provides)
-MAKE_PKGFILTER1(conflicts)
-MAKE_PKGFILTER1(replaces)
+MAKE_PKGFILTER(group,groups,Group)
+MAKE_PKGFILTER1(depends,Depends)
+MAKE_PKGFILTER1(optdepends,None)
+MAKE_PKGFILTER1(provides,Provides)
+MAKE_PKGFILTER1(conflicts,None)
+MAKE_PKGFILTER1(replaces,None)
 
 #undef MAKE_PKGFILTER
 #undef MAKE_PKGFILTER1
@@ -284,13 +438,7 @@ MAKE_PKGFILTER1(replaces)
 unique_ptr<PackageFilter>
 PackageFilter::alldepends(rptr<Match> matcher, bool neg) {
   return mk_unique<PkgFilt>(neg, [matcher](const Package &pkg) {
-    for (auto &i : pkg.depends_)
-      if ((*matcher)(i))
-        return true;
-    for (auto &i : pkg.optdepends_)
-      if ((*matcher)(i))
-        return true;
-    return false;
+    return matcher->Any(pkg.depends_) || matcher->Any(pkg.optdepends_);
   });
 }
 
@@ -318,9 +466,9 @@ unique_ptr<PackageFilter> PackageFilter::broken(bool neg) {
 
 // general purpose object filter
 unique_ptr<ObjectFilter> ObjectFilter::name(rptr<Match> matcher, bool neg) {
-  return mk_unique<ObjFilt>(neg, [matcher](const Elf &elf) {
+  return indexed(mk_unique<ObjFilt>(neg, [matcher](const Elf &elf) {
     return (*matcher)(elf.basename_);
-  });
+  }), Field::Name, matcher);
 }
 
 unique_ptr<ObjectFilter> ObjectFilter::path(rptr<Match> matcher, bool neg) {
@@ -332,46 +480,159 @@ unique_ptr<ObjectFilter> ObjectFilter::path(rptr<Match> matcher, bool neg) {
 
 unique_ptr<ObjectFilter> ObjectFilter::depends(rptr<Match> matcher, bool neg) {
   return mk_unique<ObjFilt>(neg, [matcher](const Elf &elf) {
-    for (auto &i : elf.needed_)
-      if ((*matcher)(i))
-        return true;
-    return false;
+    return matcher->Any(elf.needed_);
   });
 }
 
 // string filter
 unique_ptr<StringFilter> StringFilter::filter(rptr<Match> matcher, bool neg) {
-  return mk_unique<StrFilt>(neg, [matcher](const std::string &str) {
+  auto filt = mk_unique<StrFilt>(neg, [matcher](const std::string &str) {
     return (*matcher)(str);
   });
+  filt->match_ = matcher;
+  return filt;
+}
+
+void StringFilter::Select(const StrFilterList &filters,
+                          const StringList    &strings,
+                          std::vector<uint64_t> &mask)
+{
+  const size_t count = strings.size();
+  const size_t words = (count+63)/64;
+  mask.assign(words, ~uint64_t(0));
+  if (count % 64)
+    mask.back() = (uint64_t(1) << (count % 64)) - 1;
+
+  std::vector<uint64_t> matched(words);
+  for (auto &filt : filters) {
+    if (filt->match_) {
+      filt->match_->Matches(strings.data(), count, matched.data());
+    } else {
+      for (size_t i = 0; i != count; ++i) {
+        if (filt->visible(strings[i]))
+          matched[i/64] |= uint64_t(1) << (i%64);
+        else
+          matched[i/64] &= ~(uint64_t(1) << (i%64));
+      }
+    }
+    // the tail bits are clear in mask already
+    for (size_t w = 0; w != words; ++w)
+      mask[w] &= filt->negate_ ? ~matched[w] : matched[w];
+  }
 }
 
 bool ExactMatch::operator()(const std::string &other) const {
   return text_ == other;
 }
 
+size_t ExactMatch::Matches(const std::string *strings, size_t count,
+                           uint64_t *mask) const
+{
+  const char  *text   = text_.data();
+  const size_t length = text_.length();
+  if (!length) {
+    return match_batch(strings, count, mask, [](const std::string &str) {
+      return str.empty();
+    });
+  }
+  return match_batch(strings, count, mask,
+                     [text,length](const std::string &str) {
+    return str.length() == length && str[0] == text[0] &&
+           memcmp(str.data(), text, length) == 0;
+  });
+}
+
+bool ExactMatch::IndexKey(std::string &key, bool &exact) const {
+  key   = text_;
+  exact = true;
+  return true;
+}
+
+bool GlobMatch::IndexKey(std::string &key, bool &exact) const {
+  if (prefix_.empty())
+    return false;
+  key   = prefix_;
+  exact = (prefix_.length() == steps_.size());
+  return true;
+}
+
 bool GlobMatch::operator()(const std::string &other) const {
-  return match_glob(glob_, 0, other, 0);
+  if (!stars_ && other.length() != steps_.size())
+    return false;
+  if (other.compare(0, prefix_.length(), prefix_) != 0)
+    return false;
+  if (prefix_.length() == steps_.size())
+    return true;
+  if (suffix_.length()) {
+    if (other.length() < prefix_.length() + suffix_.length() ||
+        other.compare(other.length() - suffix_.length(), suffix_.length(),
+                      suffix_) != 0)
+    {
+      return false;
+    }
+  }
+  if (infix_.length() > 1 && !memmem(other.data() + prefix_.length(),
+                                     other.length() - prefix_.length(),
+                                     infix_.data(), infix_.length()))
+  {
+    return false;
+  }
+  return run(other, prefix_.length(), prefix_.length());
+}
+
+size_t GlobMatch::Matches(const std::string *strings, size_t count,
+                          uint64_t *mask) const
+{
+  // plain prefix globs like foo* only need the compare
+  if (stars_ && steps_.size() == prefix_.length()+1 &&
+      steps_.back().op == Op::Star)
+  {
+    const char  *prefix = prefix_.data();
+    const size_t length = prefix_.length();
+    return match_batch(strings, count, mask,
+                       [prefix,length](const std::string &str) {
+      return str.length() >= length &&
+             memcmp(str.data(), prefix, length) == 0;
+    });
+  }
+  return match_batch(strings, count, mask, [this](const std::string &str) {
+    return GlobMatch::operator()(str);
+  });
 }
 
 #ifdef WITH_REGEX
 bool RegexMatch::operator()(const std::string &other) const {
+  if (!posix_)
+    return dfa_.Search(other);
   regmatch_t rm;
   return 0 == regexec(&regex_, other.c_str(), 0, &rm, 0);
 }
+
+size_t RegexMatch::Matches(const std::string *strings, size_t count,
+                           uint64_t *mask) const
+{
+  if (posix_) {
+    return match_batch(strings, count, mask, [this](const std::string &str) {
+      regmatch_t rm;
+      return 0 == regexec(&regex_, str.c_str(), 0, &rm, 0);
+    });
+  }
+  return match_batch(strings, count, mask, [this](const std::string &str) {
+    return dfa_.Search(str);
+  });
+}
 #endif
 
 } // namespace filter
 
 #ifdef TEST
 #include <iostream>
-using filter::match_glob;
 int main() {
   std::string text("This is a stupid text.");
   int r=0;
 
   auto tryglob = [&](const char *c, bool expect) {
-    if (match_glob(c, 0, text, 0) != expect) {
+    if (filter::GlobMatch(c)(text) != expect) {
       std::cout << "FAIL: " << c << ": "
                 << (expect ? "TRUE" : "FALSE") << " expected." << std::endl;
       r=1;
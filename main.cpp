@@ -5,6 +5,13 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <limits.h>
+#include <sys/stat.h>
+
+#ifdef ENABLE_THREADS
+#  include <thread>
+#  include <mutex>
+#  include <condition_variable>
+#endif
 
 #include <archive.h>
 #include <archive_entry.h>
@@ -19,10 +26,14 @@ static const char *arg0 = 0;
 std::string   opt_default_db = "";
 unsigned int  opt_verbosity = 0;
 unsigned int  opt_json      = 0;
+unsigned int  opt_output    = OutputFormat::Text;
 unsigned int  opt_max_jobs  = 0;
 bool          opt_quiet     = false;
 bool          opt_package_depends = true;
 bool          opt_package_filelist = false;
+bool          opt_package_symbols  = false;
+bool          opt_archive_fast     = true;
+bool          opt_archive_mmap     = false;
 
 enum {
     RESET = 0,
@@ -42,7 +53,9 @@ void log(int level, const char *msg, ...) {
   if (level < LogLevel)
     return;
 
-  FILE *out = (level <= Message) ? stdout : stderr;
+  // record output has stdout to itself
+  FILE *out = (level <= Message && opt_output == OutputFormat::Text)
+              ? stdout : stderr;
 
   if (level == Message) {
     if (isatty(fileno(out))) {
@@ -62,6 +75,7 @@ static struct option long_opts[] = {
   { "quiet",   no_argument,       0, 'q' },
   { "db",      required_argument, 0, 'd' },
   { "install", no_argument,       0, 'i' },
+  { "scan",    no_argument,       0, -'S' },
   { "dry",     no_argument,       0, -'d' },
   { "remove",  no_argument,       0, 'r' },
   { "info",    no_argument,       0, 'I' },
@@ -90,6 +104,7 @@ static struct option long_opts[] = {
   { "relink",     no_argument,       0, -'R' },
 
   { "json",       required_argument, 0, 'J' },
+  { "output",     required_argument, 0, -1024-'o' },
 
   { "fixpaths",   no_argument,       0, -'F' },
 
@@ -102,8 +117,18 @@ static struct option long_opts[] = {
   { "ls",         no_argument,       0, -1026-'f' },
   { "rm-files",   no_argument,       0, -1027-'f' },
 
+  { "symbols",    optional_argument, 0, -1024-'s' },
+  { "no-symbols", no_argument,       0, -1025-'s' },
+  { "missing-symbols", no_argument,  0, -1026-'s' },
+
+  { "fast-archives", optional_argument, 0, -1024-'a' },
+  { "mmap",       optional_argument, 0, -1025-'a' },
+
   { "touch",      no_argument,       0, -1024-'T' },
 
+  { "daemon",     required_argument, 0, -1024-'d' },
+  { "connect",    required_argument, 0, -1024-'c' },
+
   { 0, 0, 0, 0 }
 };
 
@@ -119,6 +144,11 @@ static void help [[noreturn]] (int x) {
     "  -q, --quiet        suppress progress messages\n"
     "  --depends=<YES|NO> enable or disable package dependencies\n"
     "  --files=<YES|NO>   whether to store all non-object files of packages\n"
+    "  --symbols=<YES|NO> whether to store the dynamic symbols of objects\n"
+    "  --fast-archives=<YES|NO>\n"
+    "                     open .tar.{xz,zst,gz} packages without probing\n"
+    "                     for other formats (default=yes)\n"
+    "  --mmap=<YES|NO>    map package files into memory instead of reading\n"
     "  -J, --json=PART    activate json mode for parts of the program\n"
 #ifdef ENABLE_THREADS
     "  -j N               limit to at most N threads\n"
@@ -128,7 +158,7 @@ static void help [[noreturn]] (int x) {
     "json options:\n"
     "  off, n, none       no json output\n"
     "  on, q, query       use json on query outputs\n"
-    "  db                 use json to store the db (NOT RECOMMENDED)\n"
+    "  db                 use json to store the db (read back as well)\n"
     "  all, a             both\n"
     "  (optional + or - prefix to add or remove bits)\n"
     );
@@ -136,6 +166,8 @@ static void help [[noreturn]] (int x) {
     "db management options:\n"
     "  -d, --db=FILE      set the database file to commit to\n"
     "  -i, --install      install packages to a dependency db\n"
+    "  --scan             install the packages found in directories or\n"
+    "                     pacman repository dbs, skipping unchanged ones\n"
     "  -r, --remove       remove packages from the database\n"
     "  --dry              do not commit the changes to the db\n"
     "  --fixpaths         fix up path entries as older versions didn't\n"
@@ -155,6 +187,15 @@ static void help [[noreturn]] (int x) {
     "  --integrity        perform a dependency integrity check\n"
     "  -f, --filter=FILT  filter the queried packages\n"
     "  --ls               list all package files\n"
+    "  --missing-symbols  show objects with unresolved dynamic symbols\n"
+    "  --output=FORMAT    text (default, see -J), ndjson or binary records\n"
+    "                     for -P, -L, -M, -F and --ls\n"
+    );
+  fprintf(out,
+    "daemon options:\n"
+    "  --daemon=SOCKET    keep the db loaded and answer queries on SOCKET,\n"
+    "                     reloading it when the file changes\n"
+    "  --connect=SOCKET   have the daemon on SOCKET answer this query\n"
     );
   fprintf(out,
     "db query filters:\n"
@@ -177,6 +218,7 @@ static void help [[noreturn]] (int x) {
   fprintf(out,
     "rules for --rule:\n"
     "  strict:BOOL        set strict mode (default=off)\n"
+    "  ld-order:BOOL      link in ld.so search order (default=off)\n"
     "  ignore:FILENAME    add a file-ignore rule\n"
     "  unignore:FILENAME  remove a file-ignore rule\n"
     "  unignore-id:ID     remove a file-ignore rule by its id\n"
@@ -230,21 +272,82 @@ class ArgArg {
   }
 };
 
+// Packages to be installed are opened on worker threads while the database
+// is being read and modified, and handed out in command line order as they
+// become ready. Only a few packages are held in memory at a time.
+class PackageLoader {
+ public:
+  PackageLoader(StringList &&paths);
+  ~PackageLoader();
+
+  // false when all packages have been handed out,
+  // *pkg is nullptr if the package could not be read
+  bool Next(const char **path, Package **pkg);
+
+ private:
+  StringList paths_;
+  size_t     count_;
+  size_t     cur_;
+#ifdef ENABLE_THREADS
+  struct Slot {
+    Package *pkg;
+    bool     done;
+  };
+
+  void Work();
+
+  std::vector<Slot>        slots_;
+  size_t                   next_;
+  size_t                   window_;
+  bool                     stop_;
+  std::mutex               mutex_;
+  std::condition_variable  cond_;
+  std::vector<std::thread> workers_;
+#endif
+};
+
 static bool parse_rule(DB *db, const std::string& rule);
+static StringList scan_packages(const DB *db, char **args, int count);
 static bool parse_filter(const std::string &filter,
                          FilterList&,
                          ObjFilterList&,
                          StrFilterList&);
 
-int main(int argc, char **argv) {
+// daemon is set when answering a query sent to the daemon
+// daemon queries start out like a fresh process, not with the options
+// the daemon itself was started with
+static void reset_options() {
+  opt_default_db       = "";
+  opt_verbosity        = 0;
+  opt_json             = 0;
+  opt_output           = OutputFormat::Text;
+  opt_max_jobs         = 0;
+  opt_quiet            = false;
+  opt_package_depends  = true;
+  opt_package_filelist = false;
+  opt_package_symbols  = false;
+  opt_archive_fast     = true;
+  opt_archive_mmap     = false;
+}
+
+static bool same_file(const std::string &a, const std::string &b) {
+  struct stat sa, sb;
+  return ::stat(a.c_str(), &sa) == 0 && ::stat(b.c_str(), &sb) == 0 &&
+         sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static int run(int argc, char **argv, const DaemonDB *daemon) {
   arg0 = argv[0];
 
   if (argc < 2)
     help(1);
 
   std::string dbfile,
-              newname;
+              newname,
+              daemon_socket,
+              connect_socket;
   bool        do_install    = false;
+  bool        do_scan       = false;
   bool        do_delete     = false;
   bool        do_wipe       = false;
   bool        do_wipefiles  = false;
@@ -256,6 +359,7 @@ int main(int argc, char **argv) {
   bool        show_found    = false;
   bool        show_packages = false;
   bool        show_filelist = false;
+  bool        show_symbols  = false;
   bool        do_rename     = false;
   bool        do_relink     = false;
   bool        do_fixpaths   = false;
@@ -279,6 +383,8 @@ int main(int argc, char **argv) {
   StrFilterList str_filters;
 
   LogLevel = Message;
+  if (daemon)
+    reset_options();
   if (!ReadConfig())
     return 1;
 #pragma clang diagnostic push
@@ -316,6 +422,7 @@ int main(int argc, char **argv) {
       case 'v': ++opt_verbosity; break;
 
       case 'i':  oldmode = false; do_install    = true; break;
+      case -'S': oldmode = false; do_install    = do_scan = true; break;
       case 'r':  oldmode = false; do_delete     = true; break;
       case -'W': oldmode = false; do_wipe       = true; break;
       case 'I':  oldmode = false; show_info     = true; break;
@@ -334,6 +441,9 @@ int main(int argc, char **argv) {
 
       case -1024-'T': oldmode = false; modified = true; break;
 
+      case -1024-'d': daemon_socket  = optarg; break;
+      case -1024-'c': connect_socket = optarg; break;
+
       case -1024-'D':
         opt_package_depends = CfgStrToBool(optarg);
         break;
@@ -356,6 +466,27 @@ int main(int argc, char **argv) {
         do_wipefiles = true;
         break;
 
+      case -1024-'s':
+        if (optarg)
+          opt_package_symbols = CfgStrToBool(optarg);
+        else
+          opt_package_symbols = true;
+        break;
+      case -1025-'s':
+        opt_package_symbols = false;
+        break;
+      case -1026-'s':
+        oldmode = false;
+        show_symbols = true;
+        break;
+
+      case -1024-'a':
+        opt_archive_fast = optarg ? CfgStrToBool(optarg) : true;
+        break;
+      case -1025-'a':
+        opt_archive_mmap = optarg ? CfgStrToBool(optarg) : true;
+        break;
+
       case  'R': rulemod    = optarg; break;
       case -'A': ld_append  = optarg; break;
       case -'P': ld_prepend = optarg; break;
@@ -385,6 +516,10 @@ int main(int argc, char **argv) {
         if (!CfgParseJSONBit(optarg))
           help(1);
         break;
+      case -1024-'o':
+        if (!CfgParseOutput(optarg))
+          help(1);
+        break;
 
       case 'j':
         opt_max_jobs = (unsigned int)strtoul(optarg, nullptr, 0);
@@ -424,12 +559,39 @@ int main(int argc, char **argv) {
     help(1);
   }
 
+  if (do_scan && optind >= argc) {
+    log(Error, "--scan requires a list of directories or repositories\n");
+    help(1);
+  }
+
   if (do_install && optind >= argc) {
     log(Error, "--install requires a list of package archive files\n");
     help(1);
   }
 
-  std::vector<Package*> packages;
+  // the daemon runs these one at a time
+  bool writes = do_install || do_delete || do_wipe || do_wipefiles ||
+                do_rename || do_relink || modified || rulemod ||
+                ld_append || ld_prepend || ld_delete || ld_clear ||
+                ld_insert.size();
+
+  if (connect_socket.length() && !daemon)
+    return daemon_query(connect_socket, argc, argv, writes);
+
+  if (daemon) {
+    if (daemon_socket.length() || (writes && !daemon->writable)) {
+      log(Error, "query not accepted by the daemon\n");
+      return 1;
+    }
+    if (has_db && !same_file(dbfile, *daemon->dbfile)) {
+      log(Error, "the daemon serves %s, not %s\n",
+          daemon->dbfile->c_str(), dbfile.c_str());
+      return 1;
+    }
+    // the database is the daemon's
+    has_db = true;
+    dbfile = *daemon->dbfile;
+  }
 
   if (oldmode) {
     // non-database mode!
@@ -455,33 +617,32 @@ int main(int argc, char **argv) {
     return 0;
   }
 
-  if (!do_delete && optind < argc) {
-    if (do_install)
-      log(Message, "loading packages...\n");
+  if (daemon_socket.length())
+    return daemon_serve(daemon_socket, dbfile, run);
 
+  std::unique_ptr<PackageLoader> loader;
+  if (do_install && !do_scan) {
+    log(Message, "loading packages...\n");
+    loader.reset(new PackageLoader(StringList(argv+optind, argv+argc)));
+  }
+  else if (!do_delete && !do_scan) {
     while (optind < argc) {
-      if (do_install)
-        log(Print, "  %s\n", argv[optind]);
       Package *package = Package::Open(argv[optind]);
       if (!package)
         log(Error, "error reading package %s\n", argv[optind]);
       else {
-        if (do_install)
-          packages.push_back(package);
-        else {
-          package->ShowNeeded();
-          delete package;
-        }
+        package->ShowNeeded();
+        delete package;
       }
       ++optind;
     }
-
-    if (do_install)
-      log(Message, "packages loaded...\n");
   }
 
-  std::unique_ptr<DB> db(new DB);
-  if (has_db) {
+  std::unique_ptr<DB> owned;
+  DB *db = daemon ? daemon->db : nullptr;
+  if (!db) {
+    owned.reset(new DB);
+    db = owned.get();
     if (!db->Read(dbfile)) {
       log(Error, "failed to read database\n");
       return 1;
@@ -495,7 +656,7 @@ int main(int argc, char **argv) {
 
   if (rulemod) {
     for (auto &rule : rulemod.arg_)
-      modified = parse_rule(db.get(), rule) || modified;
+      modified = parse_rule(db, rule) || modified;
   }
 
   if (ld_append) {
@@ -526,9 +687,24 @@ int main(int argc, char **argv) {
     db->FixPaths();
   }
 
-  if (do_install && packages.size()) {
+  if (do_scan) {
+    // this needs the database to know which archives are unchanged
+    StringList paths = scan_packages(db, argv+optind, argc-optind);
+    if (paths.size())
+      loader.reset(new PackageLoader(std::move(paths)));
+  }
+
+  if (loader) {
     log(Message, "installing packages\n");
-    for (auto pkg : packages) {
+    const char *path;
+    Package    *pkg;
+    db->BeginBatch();
+    while (loader->Next(&path, &pkg)) {
+      log(Print, "  %s\n", path);
+      if (!pkg) {
+        log(Error, "error reading package %s\n", path);
+        continue;
+      }
       modified = true;
       if (!db->InstallPackage(std::move(pkg))) {
         printf("failed to commit package %s to database\n",
@@ -536,6 +712,8 @@ int main(int argc, char **argv) {
         break;
       }
     }
+    db->Commit();
+    loader.reset();
   }
 
   if (do_delete) {
@@ -577,12 +755,15 @@ int main(int argc, char **argv) {
   if (show_filelist)
     db->ShowFilelist(pkg_filters, str_filters);
 
+  if (show_symbols)
+    db->ShowMissingSymbols(pkg_filters, obj_filters);
+
   if (do_integrity)
     db->CheckIntegrity(pkg_filters, obj_filters);
 
   if (!dryrun && modified && has_db) {
     if (opt_json & JSONBits::DB)
-      db_store_json(db.get(), dbfile);
+      db_store_json(db, dbfile);
     else if (!db->Store(dbfile))
       log(Error, "failed to write to the database\n");
   }
@@ -590,6 +771,253 @@ int main(int argc, char **argv) {
   return 0;
 }
 
+int main(int argc, char **argv) {
+  return run(argc, argv, nullptr);
+}
+
+PackageLoader::PackageLoader(StringList &&paths)
+  : paths_(std::move(paths)), count_(paths_.size()), cur_(0)
+{
+#ifdef ENABLE_THREADS
+  next_   = 0;
+  window_ = 0;
+  stop_   = false;
+  if (opt_max_jobs == 1)
+    return;
+  unsigned int threads = std::thread::hardware_concurrency();
+  if (opt_max_jobs >= 1 && opt_max_jobs < threads)
+    threads = opt_max_jobs;
+  if (!threads)
+    threads = 1;
+  window_ = 2 * threads;
+  slots_.resize(count_, {nullptr, false});
+  // even a single worker gets to read while the database is being loaded
+  for (unsigned int i = 0; i != threads && i != count_; ++i)
+    workers_.emplace_back(&PackageLoader::Work, this);
+#endif
+}
+
+PackageLoader::~PackageLoader() {
+#ifdef ENABLE_THREADS
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (auto &t : workers_)
+    t.join();
+  for (auto &slot : slots_)
+    delete slot.pkg;
+#endif
+}
+
+#ifdef ENABLE_THREADS
+void PackageLoader::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] {
+      return stop_ || next_ == count_ || next_ < cur_ + window_;
+    });
+    if (stop_ || next_ == count_)
+      break;
+    size_t at = next_++;
+    lock.unlock();
+    Package *pkg = Package::Open(paths_[at]);
+    lock.lock();
+    slots_[at].pkg  = pkg;
+    slots_[at].done = true;
+    cond_.notify_all();
+  }
+}
+#endif
+
+bool PackageLoader::Next(const char **path, Package **pkg) {
+  if (cur_ == count_)
+    return false;
+  *path = paths_[cur_].c_str();
+#ifdef ENABLE_THREADS
+  if (workers_.size()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return slots_[cur_].done; });
+    *pkg = slots_[cur_].pkg;
+    slots_[cur_++].pkg = nullptr;
+    cond_.notify_all();
+    return true;
+  }
+#endif
+  *pkg = Package::Open(paths_[cur_++]);
+  return true;
+}
+
+// rpmvercmp as used by pacman: compares alternating runs of digits and
+// letters, numbers numerically, letters as strings
+static int vercmp_part(const std::string &a, const std::string &b) {
+  if (a == b)
+    return 0;
+  size_t one = 0, two = 0;
+  while (one < a.length() && two < b.length()) {
+    size_t sep1 = one, sep2 = two;
+    while (one < a.length() && !isalnum((unsigned char)a[one])) ++one;
+    while (two < b.length() && !isalnum((unsigned char)b[two])) ++two;
+    if (one == a.length() || two == b.length())
+      break;
+    if (one - sep1 != two - sep2)
+      return (one - sep1) < (two - sep2) ? -1 : 1;
+
+    size_t end1 = one, end2 = two;
+    bool   isnum = isdigit((unsigned char)a[one]);
+    if (isnum) {
+      while (end1 < a.length() && isdigit((unsigned char)a[end1])) ++end1;
+      while (end2 < b.length() && isdigit((unsigned char)b[end2])) ++end2;
+    } else {
+      while (end1 < a.length() && isalpha((unsigned char)a[end1])) ++end1;
+      while (end2 < b.length() && isalpha((unsigned char)b[end2])) ++end2;
+    }
+    // a number is newer than letters
+    if (end2 == two)
+      return isnum ? 1 : -1;
+
+    if (isnum) {
+      while (one < end1-1 && a[one] == '0') ++one;
+      while (two < end2-1 && b[two] == '0') ++two;
+      if (end1 - one != end2 - two)
+        return (end1 - one) < (end2 - two) ? -1 : 1;
+    }
+    int cmp = a.compare(one, end1-one, b, two, end2-two);
+    if (cmp)
+      return cmp < 0 ? -1 : 1;
+    one = end1;
+    two = end2;
+  }
+  if (one == a.length() && two == b.length())
+    return 0;
+  // 1.0 is newer than 1.0a, older than 1.0.1
+  if ((one == a.length() && !isalpha((unsigned char)b[two])) ||
+      (one != a.length() && isalpha((unsigned char)a[one])))
+  {
+    return -1;
+  }
+  return 1;
+}
+
+// [epoch:]pkgver[-pkgrel]
+static int vercmp(const std::string &a, const std::string &b) {
+  auto split = [](const std::string &v, std::string &epoch,
+                  std::string &ver, std::string &rel)
+  {
+    size_t at = 0;
+    while (at < v.length() && isdigit((unsigned char)v[at]))
+      ++at;
+    size_t from = 0;
+    if (at < v.length() && v[at] == ':') {
+      epoch = v.substr(0, at);
+      from  = at+1;
+    } else
+      epoch = "0";
+    size_t dash = v.find_last_of('-');
+    if (dash != std::string::npos && dash >= from) {
+      ver = v.substr(from, dash-from);
+      rel = v.substr(dash+1);
+    } else {
+      ver = v.substr(from);
+      rel.clear();
+    }
+  };
+  std::string e1, v1, r1, e2, v2, r2;
+  split(a, e1, v1, r1);
+  split(b, e2, v2, r2);
+  int ret = vercmp_part(e1, e2);
+  if (!ret)
+    ret = vercmp_part(v1, v2);
+  if (!ret && r1.length() && r2.length())
+    ret = vercmp_part(r1, r2);
+  return ret;
+}
+
+// name-pkgver-pkgrel-arch.pkg.tar.* into name and pkgver-pkgrel
+static bool split_archive_name(const std::string &file,
+                               std::string &name, std::string &version)
+{
+  size_t end = file.find(".pkg.tar");
+  if (end == std::string::npos)
+    return false;
+  size_t arch = file.find_last_of('-', end);
+  if (arch == std::string::npos || !arch)
+    return false;
+  size_t rel = file.find_last_of('-', arch-1);
+  if (rel == std::string::npos || !rel)
+    return false;
+  size_t ver = file.find_last_of('-', rel-1);
+  if (ver == std::string::npos || !ver)
+    return false;
+  name    = file.substr(0, ver);
+  version = file.substr(ver+1, arch-ver-1);
+  return true;
+}
+
+// package archives found in the scanned locations, except those whose name,
+// size and modification time match the archive an installed package was
+// installed from
+static StringList scan_packages(const DB *db, char **args, int count) {
+  StringList found;
+  for (int i = 0; i != count; ++i)
+    (void)FindPackageArchives(args[i], found);
+
+  auto basename = [](const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash+1);
+  };
+
+  // a package cache holds several versions of a package: only the newest
+  // one is considered, archives not following the naming scheme are kept
+  std::map<std::string, std::pair<std::string, size_t>> newest;
+  std::vector<bool> keep(found.size(), true);
+  for (size_t i = 0; i != found.size(); ++i) {
+    std::string name, version;
+    if (!split_archive_name(basename(found[i]), name, version))
+      continue;
+    auto have = newest.find(name);
+    if (have == newest.end()) {
+      newest[name] = std::make_pair(version, i);
+      continue;
+    }
+    if (vercmp(version, have->second.first) > 0) {
+      keep[have->second.second] = false;
+      have->second = std::make_pair(version, i);
+    } else
+      keep[i] = false;
+  }
+
+  std::map<std::string, const Package*> installed;
+  for (const Package *pkg : db->packages_) {
+    if (pkg->archive_name_.length())
+      installed[pkg->archive_name_] = pkg;
+  }
+
+  StringList paths;
+  size_t     older = 0;
+  for (size_t i = 0; i != found.size(); ++i) {
+    std::string &path = found[i];
+    if (!keep[i]) {
+      ++older;
+      continue;
+    }
+    auto   have  = installed.find(basename(path));
+    struct stat st;
+    if (have != installed.end() && ::stat(path.c_str(), &st) == 0 &&
+        have->second->archive_size_  == static_cast<uint64_t>(st.st_size) &&
+        have->second->archive_mtime_ == static_cast<int64_t>(st.st_mtime))
+    {
+      continue;
+    }
+    paths.push_back(std::move(path));
+  }
+  log(Message, "found %lu packages, %lu older versions, %lu unchanged\n",
+      (unsigned long)found.size(), (unsigned long)older,
+      (unsigned long)(found.size() - older - paths.size()));
+  return paths;
+}
+
 static bool try_rule(const std::string                      &rule,
                      const std::string                      &what,
                      const char                             *usage,
@@ -622,6 +1050,12 @@ static bool parse_rule(DB *db, const std::string& rule) {
       db->strict_linking_ = CfgStrToBool(cmd);
       return old == db->strict_linking_;
     })
+    || try_rule(rule, "ld-order:", "BOOL", &ret,
+    [db](const std::string &cmd) {
+      bool old = db->ld_order_;
+      db->ld_order_ = CfgStrToBool(cmd);
+      return old != db->ld_order_;
+    })
     || try_rule(rule, "unignore:", "FILENAME", &ret,
     [db](const std::string &cmd) {
       return db->IgnoreFile_Delete(cmd);
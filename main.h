@@ -6,6 +6,7 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <functional>
 
@@ -54,8 +55,19 @@ extern unsigned int opt_verbosity;
 extern bool         opt_quiet;
 extern bool         opt_package_depends;
 extern bool         opt_package_filelist;
+extern bool         opt_package_symbols;
+extern bool         opt_archive_fast;
+extern bool         opt_archive_mmap;
 extern unsigned int opt_max_jobs;
 extern unsigned int opt_json;
+extern unsigned int opt_output;
+
+namespace OutputFormat {
+  static const unsigned int
+    Text   = 0, // plain text or json, see opt_json
+    NDJSON = 1,
+    Binary = 2;
+}
 
 namespace JSONBits {
   static const unsigned int
@@ -66,6 +78,7 @@ namespace JSONBits {
 bool ReadConfig     ();
 bool CfgStrToBool   (const std::string& line);
 bool CfgParseJSONBit(const char *bit);
+bool CfgParseOutput (const char *format);
 
 class Package;
 class Elf;
@@ -74,9 +87,24 @@ using PackageList = std::vector<Package*>;
 using ObjectList  = std::vector<rptr<Elf>>;
 using StringList  = std::vector<std::string>;
 
-using ObjectSet   = std::set<rptr<Elf>>;
+// link edges: the objects are owned by their packages and the DB's list
+using ObjectSet   = std::set<Elf*>;
 using StringSet   = std::set<std::string>;
 
+/// Dynamic symbol names are hash-consed into one process wide table,
+/// objects only keep sorted lists of their IDs.
+using SymbolID    = uint32_t;
+using SymbolList  = std::vector<SymbolID>;
+
+namespace symbols {
+  SymbolID           Intern(const char *name, size_t length);
+  const std::string& Name  (SymbolID id);
+  size_t             Count ();
+  // held across fork() while another thread may be interning
+  void               Lock  ();
+  void               Unlock();
+}
+
 class Elf {
  public:
   Elf();
@@ -102,6 +130,16 @@ class Elf {
   std::string              runpath_;
   std::vector<std::string> needed_;
 
+  // DB version 9: (only with --symbols)
+  // sorted; imports are the non-weak undefined dynamic symbols,
+  // exports the visible defined ones
+  SymbolList sym_imports_;
+  SymbolList sym_exports_;
+
+  // DB version 10:
+  // hash of the file's contents, 0 if unknown (objects from older DBs)
+  uint64_t content_hash_;
+
  public: // utility functions while loading
   void SolvePaths(const std::string& origin);
   bool CanUse(const Elf &other, bool strict) const;
@@ -136,6 +174,7 @@ bool package_satisfies(const Package *other,
 #endif
 class Package {
  public:
+  Package();
   static Package* Open(const std::string& path);
 
   std::string             name_;
@@ -153,6 +192,11 @@ class Package {
   // DB version 6:
   // the filelist includes object files in v6 - makes things easier
   StringList              filelist_;
+  // DB version 11:
+  // the archive the package was installed from (file name, size, mtime)
+  std::string             archive_name_;
+  uint64_t                archive_size_;
+  int64_t                 archive_mtime_;
 
   void ShowNeeded();
   Elf* Find(const std::string &dirname, const std::string &basename) const;
@@ -168,6 +212,9 @@ class Package {
   } load_;
 };
 
+// collect the package archives in a directory tree or pacman repository db
+bool FindPackageArchives(const std::string &path, StringList &out);
+
 void fixpath(std::string& path);
 void fixpathlist(std::string& pathlist);
 
@@ -200,6 +247,7 @@ class DB {
 
   uint16_t    loaded_version_;
   bool        strict_linking_; // stored as flag bit
+  bool        ld_order_;       // stored as flag bit
 
   std::string name_;
   StringList  library_path_;
@@ -212,13 +260,28 @@ class DB {
   StringSet                         base_packages_;
   StringSet                         assume_found_rules_;
 
+  // objects by basename, in the order of objects_
+  using ObjectIndex = std::map<std::string, std::vector<Elf*>>;
+  // ids of the directories an object searches, see SearchPath
+  using DirSet = std::vector<uint32_t>;
+
  public:
+  // InstallPackage calls between these only insert the packages, linking
+  // happens once in Commit
+  void BeginBatch    ();
+  bool Commit        ();
   bool InstallPackage(Package* &&pkg);
   bool DeletePackage (const std::string& name);
   Elf *FindFor       (const Elf*, const std::string& lib,
-                      const StringList *extrapath) const;
+                      const StringList *extrapath,
+                      const ObjectIndex *index = nullptr,
+                      const DirSet *searchpath = nullptr) const;
   void LinkObject    (Elf*, const Package *owner,
-                      ObjectSet &req_found, StringSet &req_missing) const;
+                      ObjectSet &req_found, StringSet &req_missing,
+                      const ObjectIndex *index = nullptr) const;
+  void ResolveObject (const Elf*, const Package *owner,
+                      std::vector<Elf*> &req_found, StringSet &req_missing,
+                      const ObjectIndex *index = nullptr) const;
   void LinkObject_do (Elf*, const Package *owner);
   void RelinkAll     ();
   void FixPaths      ();
@@ -233,20 +296,38 @@ class DB {
   PackageList::const_iterator
            FindPkg_i (const std::string& name) const;
 
+  // Packages and objects which may pass the filters, in database order.
+  // Uses the query index where a filter allows it, the caller still has to
+  // apply all filters.
+  std::vector<Package*> SelectPackages(const FilterList&);
+  std::vector<Elf*>     SelectObjects (const FilterList&,
+                                       const ObjFilterList&);
+  // Builds the index up front, eg. before the daemon shares a version
+  // with its forked queries.
+  void BuildQueryIndex();
+
   void ShowInfo();
   void ShowInfo_json();
   void ShowPackages     (bool filter_broken, bool filter_notempty,
                          const FilterList&, const ObjFilterList&);
   void ShowPackages_json(bool filter_broken, bool filter_notempty,
                          const FilterList&, const ObjFilterList&);
+  void ShowPackages_records(bool filter_broken, bool filter_notempty,
+                            const FilterList&, const ObjFilterList&);
   void ShowObjects      (const FilterList&, const ObjFilterList&);
   void ShowObjects_json (const FilterList&, const ObjFilterList&);
+  void ShowObjects_records(const FilterList&, const ObjFilterList&);
   void ShowMissing      ();
   void ShowMissing_json ();
+  void ShowMissing_records();
   void ShowFound        ();
   void ShowFound_json   ();
+  void ShowFound_records();
   void ShowFilelist     (const FilterList&, const StrFilterList&);
   void ShowFilelist_json(const FilterList&, const StrFilterList&);
+  void ShowFilelist_records(const FilterList&, const StrFilterList&);
+  void ShowMissingSymbols     (const FilterList&, const ObjFilterList&);
+  void ShowMissingSymbols_json(const FilterList&, const ObjFilterList&);
 
   void CheckIntegrity(const FilterList &pkg_filters,
                       const ObjFilterList &obj_filters) const;
@@ -290,6 +371,12 @@ class DB {
  private:
   bool ElfFinds(const Elf*, const std::string& lib,
                 const StringList *extrapath) const;
+  void SearchOrder(const Elf*, const StringList *extrapath,
+                   StringList &dirs) const;
+  void SearchPath(const Elf*, const StringList *extrapath,
+                  DirSet &dirs) const;
+  void ReuseObjects(Package *old, Package *pkg,
+                    std::set<const Elf*> &reused) const;
 
   const StringList* GetObjectLibPath(const Elf*) const;
   const StringList* GetPackageLibPath(const Package*) const;
@@ -298,11 +385,52 @@ class DB {
   bool IsBroken(const Package *pkg) const;
   bool IsBroken(const Elf *elf) const;
   bool IsEmpty (const Package *elf, const ObjFilterList &filters) const;
+  bool MissingSymbols(const Elf *elf, SymbolList &missing) const;
 
  public: // NOT SERIALIZED:
   bool contains_package_depends_;
   bool contains_groups_;
   bool contains_filelists_;
+  bool contains_symbols_;
+
+ private:
+  // Column-wise copy of what the linker compares, so full scans in FindFor
+  // walk a few flat arrays instead of every object. Only exists during
+  // operations which link against the whole database. Directory and file
+  // names share one id space.
+  struct ObjectTable {
+    std::vector<Elf*>     objects;
+    std::vector<uint32_t> objclass; // packed, see getObjClass
+    std::vector<uint32_t> basename; // ids into names
+    std::vector<uint32_t> dirname;  // ids into names
+    StringList            names;
+    std::map<std::string, uint32_t> ids;
+    // (dirname << 32 | basename) -> rows, only with ld_order_
+    std::unordered_map<uint64_t, std::vector<uint32_t>> files;
+  } table_;
+
+  void BuildObjectTable();
+
+  // Sorted (string, position) lists for the filter fields which can be
+  // looked up. Built by the first query with a filter which can use it (or
+  // by BuildQueryIndex), dropped whenever the package or object lists
+  // change.
+  using KeyIndex = std::vector<std::pair<std::string, uint32_t>>;
+  struct {
+    bool     valid;
+    KeyIndex pkgname, group, depends, provides; // into packages_
+    KeyIndex objname;                           // into objects_
+    std::unordered_map<const Elf*, uint32_t> objpos;
+  } query_index_;
+
+  bool PlanPackages(const FilterList&, std::vector<uint32_t> &selection) const;
+
+  struct {
+    bool      active;
+    ObjectSet  added;   // not linked yet
+    ObjectSet  removed; // still in other objects' link results
+    ObjectList keep;    // keeps the removed objects alive until Commit
+  } batch_;
 };
 
 namespace filter {
@@ -312,6 +440,14 @@ class Match {
   Match();
   virtual ~Match();
   virtual bool operator()(const std::string&) const = 0;
+  // batch version: sets bit i%64 of mask[i/64] for each matching
+  // strings[i], clears the others, returns the number of matches
+  virtual size_t Matches(const std::string *strings, size_t count,
+                         uint64_t *mask) const;
+  bool Any(const StringList&) const;
+  // a string all matches are equal to (exact) or start with, for lookups
+  // in sorted indexes
+  virtual bool IndexKey(std::string &key, bool &exact) const;
 
   static rptr<Match> CreateExact(std::string &&text);
   static rptr<Match> CreateGlob (std::string &&text);
@@ -326,7 +462,18 @@ class PackageFilter {
  public:
   PackageFilter() = delete;
 
-  bool negate_;
+  // filters matching a single string field can be answered from an index
+  enum class Field {
+    None,
+    Name,
+    Group,
+    Depends,
+    Provides
+  };
+
+  bool        negate_;
+  Field       field_;
+  rptr<Match> match_;
   virtual ~PackageFilter();
   virtual bool visible(const Package &pkg) const {
     (void)pkg; return true;
@@ -357,8 +504,16 @@ class ObjectFilter {
  public:
   ObjectFilter() = delete;
 
-  size_t refcount_;
-  bool   negate_;
+  // filters matching a single string field can be answered from an index
+  enum class Field {
+    None,
+    Name
+  };
+
+  size_t      refcount_;
+  bool        negate_;
+  Field       field_;
+  rptr<Match> match_;
 
   virtual ~ObjectFilter();
   virtual bool visible(const Elf &elf) const {
@@ -382,7 +537,8 @@ class StringFilter {
  public:
   StringFilter() = delete;
 
-  bool negate_;
+  bool        negate_;
+  rptr<Match> match_;
   virtual ~StringFilter();
 
   virtual bool visible(const std::string& str) const {
@@ -393,10 +549,29 @@ class StringFilter {
   }
 
   static unique_ptr<StringFilter> filter(rptr<Match>, bool neg);
+
+  // sets the mask bits (as in Match::Matches) of the strings visible
+  // through all filters
+  static void Select(const StrFilterList&, const StringList&,
+                     std::vector<uint64_t> &mask);
 };
 
 }
 
 bool db_store_json(DB *db, const std::string& filename);
+bool db_read_json (DB *db, const std::string& filename);
+
+// what a query answered by the daemon works on
+struct DaemonDB {
+  DB                *db;
+  const std::string *dbfile;   // where changes are stored
+  bool               writable; // whether the query may change anything
+};
+// runs a query given as command line arguments
+using DaemonQuery = int (*)(int argc, char **argv, const DaemonDB *daemon);
+int daemon_serve(const std::string &socket, const std::string &dbfile,
+                 DaemonQuery query);
+int daemon_query(const std::string &socket, int argc, char **argv,
+                 bool writes);
 
 #endif
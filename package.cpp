@@ -1,8 +1,26 @@
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
 #include <memory>
+#include <algorithm>
+#include <unordered_map>
 
 #include <archive.h>
 #include <archive_entry.h>
 
+#if defined(ENABLE_THREADS) && defined(WITH_MT_DECOMPRESS)
+#  include <thread>
+#  include <mutex>
+#  include <condition_variable>
+#  include <lzma.h>
+#  include <zstd.h>
+#endif
+
 #include "main.h"
 
 static bool care_about(struct archive_entry *entry, mode_t mode) {
@@ -160,6 +178,64 @@ static bool read_info(Package *pkg, struct archive *tar, const size_t size) {
   return true;
 }
 
+// XXH64 (seed 0) of an object's contents. Used by DB::InstallPackage to
+// recognize objects which did not change between two package builds.
+namespace xxh {
+  static const uint64_t P1 = 11400714785074694791ULL,
+                        P2 = 14029467366897019727ULL,
+                        P3 =  1609587929392839161ULL,
+                        P4 =  9650029242287828579ULL,
+                        P5 =  2870177450012600261ULL;
+
+  static inline uint64_t rotl(uint64_t x, unsigned r) {
+    return (x << r) | (x >> (64 - r));
+  }
+  static inline uint64_t read64(const unsigned char *p) {
+    uint64_t v; memcpy(&v, p, sizeof(v)); return v;
+  }
+  static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v; memcpy(&v, p, sizeof(v)); return v;
+  }
+  static inline uint64_t round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * P2, 31) * P1;
+  }
+  static inline uint64_t merge(uint64_t acc, uint64_t val) {
+    return (acc ^ round(0, val)) * P1 + P4;
+  }
+
+  static uint64_t hash(const char *data, size_t length) {
+    auto p   = reinterpret_cast<const unsigned char*>(data);
+    auto end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+      uint64_t v1 = P1 + P2, v2 = P2, v3 = 0, v4 = 0 - P1;
+      do {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p+8));
+        v3 = round(v3, read64(p+16));
+        v4 = round(v4, read64(p+24));
+        p += 32;
+      } while (end - p >= 32);
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    } else
+      h = P5;
+    h += length;
+    for (; end - p >= 8; p += 8)
+      h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (end - p >= 4) {
+      h = rotl(h ^ (uint64_t(read32(p)) * P1), 23) * P2 + P3;
+      p += 4;
+    }
+    for (; p != end; ++p)
+      h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33; h *= P2;
+    h ^= h >> 29; h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+}
+
 static inline
 std::tuple<std::string, std::string> splitpath(const std::string& path)
 {
@@ -197,6 +273,7 @@ static bool read_object(Package         *pkg,
       log(Error, "error in: %s\n", filename.c_str());
     return !err;
   }
+  object->content_hash_ = xxh::hash(&data[0], data.size());
 
   auto split(std::move(splitpath(filename)));
   object->dirname_  = std::move(std::get<0>(split));
@@ -262,6 +339,11 @@ static bool add_entry(Package              *pkg,
   return read_object(pkg, tar, std::move(filename), size);
 }
 
+Package::Package()
+: archive_size_(0),
+  archive_mtime_(0)
+{}
+
 Elf* Package::Find(const std::string& dirname,
                    const std::string& basename) const
 {
@@ -343,21 +425,457 @@ void Package::Guess(const std::string& path) {
   }
 }
 
+// Symlinks become copies of the object they eventually point to. Chains are
+// followed through path indices, so every link is looked at only once; links
+// which are part of a cycle or dangle are dropped.
+static void resolve_symlinks(Package *pkg) {
+  struct Link {
+    std::tuple<std::string, std::string> from;
+    std::string to;
+    enum { Unvisited, Visiting, Done } state;
+    Elf *obj;
+  };
+
+  std::unordered_map<std::string, Elf*> objects;
+  for (auto &obj : pkg->objects_)
+    objects.emplace(obj->dirname_ + "/" + obj->basename_, obj.get());
+
+  std::vector<Link> links;
+  std::unordered_map<std::string, size_t> linkindex;
+  links.reserve(pkg->load_.symlinks.size());
+  for (auto &link : pkg->load_.symlinks) {
+    // handle relative as well as absolute symlinks
+    if (!link.second.length()) // illegal
+      continue;
+    auto linkfrom = splitpath(link.first);
+    auto linkto = (link.second[0] == '/')
+                ? splitpath(link.second)
+                : splitpath(std::get<0>(linkfrom) + "/" + link.second);
+    linkindex.emplace(std::get<0>(linkfrom) + "/" + std::get<1>(linkfrom),
+                      links.size());
+    links.push_back({std::move(linkfrom),
+                     std::get<0>(linkto) + "/" + std::get<1>(linkto),
+                     Link::Unvisited, nullptr});
+  }
+
+  std::vector<size_t> chain;
+  for (size_t i = 0; i != links.size(); ++i) {
+    // walk down the chain until we hit an object or a link we've seen before
+    Elf   *target = nullptr;
+    size_t at     = i;
+    while (links[at].state == Link::Unvisited) {
+      links[at].state = Link::Visiting;
+      chain.push_back(at);
+      auto obj = objects.find(links[at].to);
+      if (obj != objects.end()) {
+        target = obj->second;
+        break;
+      }
+      auto next = linkindex.find(links[at].to);
+      if (next == linkindex.end())
+        break;
+      at = next->second;
+    }
+    // a Visiting link at this point means we ran in a circle
+    if (!target && links[at].state == Link::Done)
+      target = links[at].obj;
+
+    // and back up, the innermost link first
+    while (!chain.empty()) {
+      Link &link = links[chain.back()];
+      chain.pop_back();
+      link.state = Link::Done;
+      if (!target)
+        continue;
+
+      Elf *copy = new Elf(*target);
+      copy->dirname_  = std::move(std::get<0>(link.from));
+      copy->basename_ = std::move(std::get<1>(link.from));
+      copy->SolvePaths(target->dirname_);
+
+      pkg->objects_.push_back(copy);
+      link.obj = target = copy;
+    }
+  }
+}
+
+// read block size for archive files
+static const size_t archive_block_size = 256 * 1024;
+
+// a package file mapped into memory (--mmap)
+class MappedFile {
+ public:
+  MappedFile() : data_(MAP_FAILED), size_(0) {}
+  ~MappedFile() {
+    if (data_ != MAP_FAILED)
+      ::munmap(data_, size_);
+  }
+
+  bool Open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      size_ = static_cast<size_t>(st.st_size);
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data_ != MAP_FAILED)
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    return data_ != MAP_FAILED;
+  }
+
+  bool   mapped() const { return data_ != MAP_FAILED; }
+  void  *data()   const { return data_; }
+  size_t size()   const { return size_; }
+
+ private:
+  void  *data_;
+  size_t size_;
+};
+
+#if defined(ENABLE_THREADS) && defined(WITH_MT_DECOMPRESS)
+// Big packages are decompressed outside of libarchive, so that the blocks of
+// multi-block xz files and the frames of multi-frame zstd files can be
+// decoded in parallel. libarchive then only parses the tar stream.
+namespace mtdecomp {
+
+// smaller packages aren't worth the threads
+static const size_t min_size = 32 * 1024 * 1024;
+
+static unsigned int threadcount() {
+  unsigned int n = std::thread::hardware_concurrency();
+  if (opt_max_jobs >= 1 && opt_max_jobs < n)
+    n = opt_max_jobs;
+  return n ? n : 1;
+}
+
+static bool worth_it(const std::string &path) {
+  struct stat st;
+  return threadcount() > 1 &&
+         ::stat(path.c_str(), &st) == 0 &&
+         static_cast<size_t>(st.st_size) >= min_size;
+}
+
+class Source {
+ public:
+  virtual ~Source() {}
+  // number of bytes available at *out, 0 at the end, -1 on error
+  virtual ssize_t Read(const void **out) = 0;
+
+  std::string error_;
+};
+
+#if LZMA_VERSION >= 50040002
+// liblzma's own threaded decoder, it decodes whole xz blocks in parallel
+// and bounds its memory use by itself
+class XZSource : public Source {
+ public:
+  XZSource() : strm_(LZMA_STREAM_INIT), done_(false) {}
+  ~XZSource() { lzma_end(&strm_); }
+
+  static Source* Create(const char *data, size_t size, unsigned int threads) {
+    std::unique_ptr<XZSource> src(new XZSource);
+    lzma_mt mt;
+    memset(&mt, 0, sizeof(mt));
+    mt.threads            = threads;
+    mt.flags              = LZMA_CONCATENATED;
+    mt.memlimit_threading = lzma_physmem() / 4;
+    mt.memlimit_stop      = UINT64_MAX;
+    if (lzma_stream_decoder_mt(&src->strm_, &mt) != LZMA_OK)
+      return nullptr;
+    src->strm_.next_in  = reinterpret_cast<const uint8_t*>(data);
+    src->strm_.avail_in = size;
+    src->buffer_.resize(1024 * 1024);
+    return src.release();
+  }
+
+  ssize_t Read(const void **out) {
+    strm_.next_out  = reinterpret_cast<uint8_t*>(&buffer_[0]);
+    strm_.avail_out = buffer_.size();
+    while (!done_ && strm_.avail_out) {
+      lzma_ret ret = lzma_code(&strm_, LZMA_FINISH);
+      if (ret == LZMA_STREAM_END)
+        done_ = true;
+      else if (ret != LZMA_OK) {
+        error_ = "xz: failed to decompress package";
+        return -1;
+      }
+    }
+    *out = &buffer_[0];
+    return static_cast<ssize_t>(buffer_.size() - strm_.avail_out);
+  }
+
+ private:
+  lzma_stream       strm_;
+  bool              done_;
+  std::vector<char> buffer_;
+};
+#endif
+
+// Frames are handed out to the workers in order, at most window_ frames
+// ahead of the one libarchive is currently reading.
+class ZstdSource : public Source {
+ public:
+  static Source* Create(const char *data, size_t size, unsigned int threads) {
+    std::unique_ptr<ZstdSource> src(new ZstdSource);
+    while (size) {
+      size_t len = ZSTD_findFrameCompressedSize(data, size);
+      if (ZSTD_isError(len))
+        return nullptr;
+      src->frames_.push_back({data, len, {}, false, false});
+      data += len;
+      size -= len;
+    }
+    // a single frame can't be split up
+    if (src->frames_.size() < 2)
+      return nullptr;
+    src->window_ = 2 * threads;
+    for (unsigned int i = 0; i != threads; ++i)
+      src->workers_.emplace_back(&ZstdSource::Work, src.get());
+    return src.release();
+  }
+
+  ~ZstdSource() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto &t : workers_)
+      t.join();
+  }
+
+  ssize_t Read(const void **out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (cur_ != frames_.size()) {
+      cond_.wait(lock, [this] { return frames_[cur_].done; });
+      Frame &frame = frames_[cur_++];
+      cond_.notify_all();
+      if (frame.failed) {
+        error_ = "zstd: failed to decompress package";
+        return -1;
+      }
+      current_ = std::move(frame.out);
+      if (current_.empty())
+        continue;
+      *out = &current_[0];
+      return static_cast<ssize_t>(current_.size());
+    }
+    return 0;
+  }
+
+ private:
+  struct Frame {
+    const char        *data;
+    size_t             size;
+    std::vector<char>  out;
+    bool               done;
+    bool               failed;
+  };
+
+  ZstdSource() : cur_(0), next_(0), window_(0), stop_(false) {}
+
+  static bool Decode(ZSTD_DCtx *ctx, Frame &frame) {
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+    unsigned long long expect = ZSTD_getFrameContentSize(frame.data,
+                                                         frame.size);
+    if (expect != ZSTD_CONTENTSIZE_UNKNOWN &&
+        expect != ZSTD_CONTENTSIZE_ERROR)
+    {
+      frame.out.reserve(expect);
+    }
+
+    ZSTD_inBuffer in = { frame.data, frame.size, 0 };
+    size_t have = 0;
+    size_t ret;
+    do {
+      frame.out.resize(have + ZSTD_DStreamOutSize());
+      ZSTD_outBuffer out = { &frame.out[have], frame.out.size() - have, 0 };
+      ret = ZSTD_decompressStream(ctx, &out, &in);
+      if (ZSTD_isError(ret))
+        return false;
+      have += out.pos;
+      // a truncated frame wants more input than there is
+      if (ret && in.pos == in.size && out.pos < out.size)
+        return false;
+    } while (ret);
+    frame.out.resize(have);
+    return true;
+  }
+
+  void Work() {
+    ZSTD_DCtx *ctx = ZSTD_createDCtx();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cond_.wait(lock, [this] {
+        return stop_ || next_ == frames_.size() || next_ < cur_ + window_;
+      });
+      if (stop_ || next_ == frames_.size())
+        break;
+      Frame &frame = frames_[next_++];
+      lock.unlock();
+      bool ok = ctx && Decode(ctx, frame);
+      lock.lock();
+      frame.done   = true;
+      frame.failed = !ok;
+      cond_.notify_all();
+    }
+    ZSTD_freeDCtx(ctx);
+  }
+
+  std::vector<Frame>       frames_;
+  size_t                   cur_;
+  size_t                   next_;
+  size_t                   window_;
+  bool                     stop_;
+  std::vector<char>        current_;
+  std::mutex               mutex_;
+  std::condition_variable  cond_;
+  std::vector<std::thread> workers_;
+};
+
+static la_ssize_t read_cb(struct archive *tar, void *ud, const void **buf) {
+  Source *src = static_cast<Source*>(ud);
+  ssize_t got = src->Read(buf);
+  if (got < 0)
+    archive_set_error(tar, EIO, "%s", src->error_.c_str());
+  return got;
+}
+
+static int close_cb(struct archive*, void *ud) {
+  delete static_cast<Source*>(ud);
+  return ARCHIVE_OK;
+}
+
+// nullptr if the file isn't something we can decompress in parallel
+static struct archive* open(const MappedFile &mapped) {
+  const char  *data = static_cast<const char*>(mapped.data());
+  size_t       size = mapped.size();
+  unsigned int threads = threadcount();
+
+  Source *src = nullptr;
+#if LZMA_VERSION >= 50040002
+  if (size >= 6 && memcmp(data, "\xFD" "7zXZ\0", 6) == 0)
+    src = XZSource::Create(data, size, threads);
+#endif
+  if (size >= 4 && memcmp(data, "\x28\xB5\x2F\xFD", 4) == 0)
+    src = ZstdSource::Create(data, size, threads);
+  if (!src)
+    return nullptr;
+  log(Debug, "decompressing with %u threads\n", threads);
+
+  struct archive *tar = archive_read_new();
+  archive_read_support_format_tar(tar);
+  // from here on the close callback owns the source
+  if (ARCHIVE_OK != archive_read_open(tar, src, nullptr, read_cb, close_cb)) {
+    archive_read_free(tar);
+    return nullptr;
+  }
+  return tar;
+}
+
+} // namespace mtdecomp
+#endif
+
+// The usual package extensions: these get only the tar format and their one
+// compression filter instead of letting libarchive probe everything.
+static int (*fast_filter(const std::string &path))(struct archive*) {
+  static const struct {
+    const char *ext;
+    int (*filter)(struct archive*);
+  } known[] = {
+    { ".tar.xz",  archive_read_support_filter_xz },
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+    { ".tar.zst", archive_read_support_filter_zstd },
+#endif
+    { ".tar.gz",  archive_read_support_filter_gzip },
+    { ".tgz",     archive_read_support_filter_gzip },
+    { ".txz",     archive_read_support_filter_xz },
+    { ".tar",     archive_read_support_filter_none },
+  };
+  for (auto &k : known) {
+    size_t len = strlen(k.ext);
+    if (path.length() > len &&
+        path.compare(path.length()-len, len, k.ext) == 0)
+    {
+      return k.filter;
+    }
+  }
+  return nullptr;
+}
+
+static struct archive* open_archive(const std::string &path,
+                                    const MappedFile  &mapped,
+                                    int (*filter)(struct archive*))
+{
+  struct archive *tar = archive_read_new();
+  if (filter) {
+    filter(tar);
+    archive_read_support_format_tar(tar);
+  } else {
+    archive_read_support_filter_all(tar);
+    archive_read_support_format_all(tar);
+  }
+
+  int rc = mapped.mapped()
+         ? archive_read_open_memory(tar, mapped.data(), mapped.size())
+         : archive_read_open_filename(tar, path.c_str(), archive_block_size);
+  if (ARCHIVE_OK != rc) {
+    archive_read_free(tar);
+    return nullptr;
+  }
+  return tar;
+}
+
 Package* Package::Open(const std::string& path) {
   std::unique_ptr<Package> package(new Package);
 
-  struct archive *tar = archive_read_new();
-  archive_read_support_filter_all(tar);
-  archive_read_support_format_all(tar);
+  MappedFile mapped;
+  if (opt_archive_mmap)
+    (void)mapped.Open(path); // otherwise we simply read the file
+#if defined(ENABLE_THREADS) && defined(WITH_MT_DECOMPRESS)
+  else if (mtdecomp::worth_it(path))
+    (void)mapped.Open(path);
+#endif
 
+  struct archive       *tar = nullptr;
   struct archive_entry *entry;
-  if (ARCHIVE_OK != archive_read_open_filename(tar, path.c_str(), 10240)) {
-    return 0;
+  int rc = ARCHIVE_FATAL;
+
+#if defined(ENABLE_THREADS) && defined(WITH_MT_DECOMPRESS)
+  if (mapped.mapped() && mapped.size() >= mtdecomp::min_size &&
+      (tar = mtdecomp::open(mapped)))
+  {
+    rc = archive_read_next_header(tar, &entry);
+    if (ARCHIVE_OK != rc) {
+      archive_read_free(tar);
+      tar = nullptr;
+    }
   }
+#endif
 
-  while (ARCHIVE_OK == archive_read_next_header(tar, &entry)) {
-    if (!add_entry(package.get(), tar, entry))
+  auto filter = opt_archive_fast ? fast_filter(path) : nullptr;
+  if (!tar && filter && (tar = open_archive(path, mapped, filter))) {
+    rc = archive_read_next_header(tar, &entry);
+    if (ARCHIVE_OK != rc) {
+      // not what the name claims, let libarchive figure it out
+      archive_read_free(tar);
+      tar = nullptr;
+    }
+  }
+  if (!tar) {
+    if (!(tar = open_archive(path, mapped, nullptr)))
       return 0;
+    rc = archive_read_next_header(tar, &entry);
+  }
+
+  for (; ARCHIVE_OK == rc; rc = archive_read_next_header(tar, &entry)) {
+    if (!add_entry(package.get(), tar, entry)) {
+      archive_read_free(tar);
+      return 0;
+    }
   }
 
   archive_read_free(tar);
@@ -365,47 +883,140 @@ Package* Package::Open(const std::string& path) {
   if (!package->name_.length() && !package->version_.length())
     package->Guess(path);
 
-  bool changed;
-  do {
-    changed = false;
-    for (auto link = package->load_.symlinks.begin(); link != package->load_.symlinks.end();)
-    {
-      auto linkfrom = splitpath(link->first);
-      decltype(linkfrom) linkto;
+  struct stat st;
+  if (::stat(path.c_str(), &st) == 0) {
+    size_t slash = path.find_last_of('/');
+    package->archive_name_  = (slash == std::string::npos)
+                            ? path : path.substr(slash+1);
+    package->archive_size_  = static_cast<uint64_t>(st.st_size);
+    package->archive_mtime_ = static_cast<int64_t>(st.st_mtime);
+  }
 
-      // handle relative as well as absolute symlinks
-      if (!link->second.length()) {
-        // illegal
-        ++link;
-        continue;
-      }
-      if (link->second[0] == '/') // absolute
-        linkto = splitpath(link->second);
-      else // relative
-      {
-        std::string fullpath = std::get<0>(linkfrom) + "/" + link->second;
-        linkto = splitpath(fullpath);
-      }
+  resolve_symlinks(package.get());
+  package->load_.symlinks.clear();
 
-      Elf *obj = package->Find(std::get<0>(linkto), std::get<1>(linkto));
-      if (!obj) {
-        ++link;
-        continue;
-      }
-      changed = true;
+  return package.release();
+}
 
-      Elf *copy = new Elf(*obj);
-      copy->dirname_  = std::move(std::get<0>(linkfrom));
-      copy->basename_ = std::move(std::get<1>(linkfrom));
-      copy->SolvePaths(obj->dirname_);
+static bool ends_with(const std::string &str, const char *suffix) {
+  size_t len = strlen(suffix);
+  return str.length() >= len &&
+         str.compare(str.length()-len, len, suffix) == 0;
+}
+
+static bool is_package_archive(const std::string &name) {
+  if (ends_with(name, ".sig"))
+    return false;
+  return name.find(".pkg.tar") != std::string::npos ||
+         ends_with(name, ".tgz") ||
+         ends_with(name, ".txz");
+}
+
+static bool is_repo_db(const std::string &name) {
+  return ends_with(name, ".db")    ||
+         ends_with(name, ".files") ||
+         name.find(".db.tar")    != std::string::npos ||
+         name.find(".files.tar") != std::string::npos;
+}
 
-      package->objects_.push_back(copy);
-      package->load_.symlinks.erase(link++);
+static bool scan_directory(const std::string &dir, StringList &out) {
+  DIR *dh = ::opendir(dir.c_str());
+  if (!dh) {
+    log(Error, "failed to open directory %s: %s\n",
+        dir.c_str(), ::strerror(errno));
+    return false;
+  }
+  StringList names;
+  while (struct dirent *ent = ::readdir(dh)) {
+    if (ent->d_name[0] != '.')
+      names.push_back(ent->d_name);
+  }
+  ::closedir(dh);
+  std::sort(names.begin(), names.end());
+
+  for (auto &name : names) {
+    std::string path = dir + "/" + name;
+    struct stat st;
+    // don't follow symlinked directories, but do follow symlinked packages
+    if (::lstat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (!scan_directory(path, out))
+        log(Warn, "skipping %s\n", path.c_str());
+      continue;
     }
-  } while (changed);
-  package->load_.symlinks.clear();
+    if (S_ISLNK(st.st_mode) && ::stat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISREG(st.st_mode) && is_package_archive(name))
+      out.push_back(std::move(path));
+  }
+  return true;
+}
 
-  return package.release();
+// the package files listed in a pacman repository database,
+// expected to be next to the database file
+static bool scan_repo_db(const std::string &path, StringList &out) {
+  size_t slash = path.find_last_of('/');
+  std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash);
+
+  struct archive *tar = archive_read_new();
+  archive_read_support_filter_all(tar);
+  archive_read_support_format_all(tar);
+  if (ARCHIVE_OK != archive_read_open_filename(tar, path.c_str(),
+                                               archive_block_size))
+  {
+    log(Error, "failed to open repository database %s\n", path.c_str());
+    archive_read_free(tar);
+    return false;
+  }
+
+  static const std::string tag("%FILENAME%\n");
+  struct archive_entry *entry;
+  std::string desc;
+  while (ARCHIVE_OK == archive_read_next_header(tar, &entry)) {
+    std::string name(archive_entry_pathname(entry));
+    if (name != "desc" && !ends_with(name, "/desc"))
+      continue;
+    desc.resize(static_cast<size_t>(archive_entry_size(entry)));
+    if (desc.empty())
+      continue;
+    ssize_t rc = archive_read_data(tar, &desc[0], desc.length());
+    if (rc < 0 || (size_t)rc != desc.length()) {
+      log(Error, "failed to read %s in %s\n", name.c_str(), path.c_str());
+      archive_read_free(tar);
+      return false;
+    }
+
+    size_t at = desc.find(tag);
+    if (at == std::string::npos)
+      continue;
+    at += tag.length();
+    std::string file = desc.substr(at, desc.find('\n', at) - at);
+    if (file.empty())
+      continue;
+    file = dir + "/" + file;
+    if (::access(file.c_str(), R_OK) != 0) {
+      log(Warn, "%s: package not found: %s\n", path.c_str(), file.c_str());
+      continue;
+    }
+    out.push_back(std::move(file));
+  }
+  archive_read_free(tar);
+  return true;
+}
+
+bool FindPackageArchives(const std::string &path, StringList &out) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    log(Error, "%s: %s\n", path.c_str(), ::strerror(errno));
+    return false;
+  }
+  if (S_ISDIR(st.st_mode))
+    return scan_directory(path, out);
+  if (is_repo_db(path))
+    return scan_repo_db(path, out);
+  out.push_back(path);
+  return true;
 }
 
 void Package::ShowNeeded() {
@@ -429,7 +1040,7 @@ bool Package::ConflictsWith(const Package &other) const {
         return true;
     } else {
 #else
-      std::string &name(conf);
+      const std::string &name(conf);
 #endif
       if (other.name_ == name)
         return true;
@@ -438,7 +1049,7 @@ bool Package::ConflictsWith(const Package &other) const {
         std::string provname;
         split_depstring(prov, provname, op, ver);
 #else
-        std::string &provname(prov);
+        const std::string &provname(prov);
 #endif
         if (provname == name)
           return true;